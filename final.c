@@ -1,1448 +1,3817 @@
-#define _POSIX_C_SOURCE 200809L
-#include<string.h>
-#include<stdio.h>
-#include<stdlib.h>
-#include<ctype.h>
-#include<math.h>
-#include<time.h>
-
-struct Sheet;
-struct Cell;
-
-int setarith(struct Cell* target_cell, int val1, int val2, int opcode);
-int setfunc(struct Cell* target_cell, int* values, int count, int opcode);
-void sleep(int seconds);
-void get_column_name(int col, char* buffer);
-
-
-typedef struct DependencyNode {
-    int row;
-    int col;
-    struct DependencyNode* next;
-} DependencyNode;
-
-struct Cell {
-    int value;
-    char* formula;
-    struct DependencyNode* depends_on;    
-    struct DependencyNode* dependents;    
-    int has_error;                        
-};
-
-enum CommandType {
-    CMD_CONTROL, 
-    CMD_SETCONST,    
-    CMD_SETARITH,
-    CMD_SETFUNC,   
-    CMD_DISABLE_OUTPUT, 
-    CMD_ENABLE_OUTPUT,  
-    CMD_SCROLL_TO,    
-    CMD_INVALID     
-};
-
-struct Command {
-    enum CommandType type;
-    char* args[4];  
- };
-struct Sheet {
-    struct Cell** cells;
-    int rows;
-    int cols;
-    int view_row;  
-    int view_col;  
-    int suppress_output;  
-};
-
-double calculate_stdev(int* values, int count) {
-    if (count <= 1) return 0;
-    double mean = 0;
-    for (int i = 0; i < count; i++) {
-        mean += values[i];
-    }
-    mean /= count;
-    double sum_sq_diff = 0;
-    for (int i = 0; i < count; i++) {
-        double diff = values[i] - mean;
-        sum_sq_diff += diff * diff;
-    }
-    return sqrt(sum_sq_diff / (count - 1));
-}
-void add_dependency(struct Cell* dependent, int dep_row, int dep_col) {
-    DependencyNode* curr = dependent->depends_on;
-    while (curr) {
-        if (curr->row == dep_row && curr->col == dep_col) {
-            return;
-        }
-        curr = curr->next;
-    }
-    DependencyNode* new_node = malloc(sizeof(DependencyNode));
-    if (!new_node) return;
-    
-    new_node->row = dep_row;
-    new_node->col = dep_col;
-    new_node->next = dependent->depends_on;
-    dependent->depends_on = new_node;
-}
-void add_dependent(struct Cell* dependency, int dep_row, int dep_col) {
-    DependencyNode* curr = dependency->dependents;
-    while (curr) {
-        if (curr->row == dep_row && curr->col == dep_col) {
-            return; 
-        }
-        curr = curr->next;
-    }
-    DependencyNode* new_node = malloc(sizeof(DependencyNode));
-    if (!new_node) return;
-    
-    new_node->row = dep_row;
-    new_node->col = dep_col;
-    new_node->next = dependency->dependents;
-    dependency->dependents = new_node;
-}
-void clear_dependencies(struct Cell* cell) {
-    DependencyNode* curr = cell->depends_on;
-    while (curr) {
-        DependencyNode* dep_node = curr;
-        curr = curr->next;
-        free(dep_node);
-    }
-    cell->depends_on = NULL;
-}
-
-//Below fumctiom prints dependencies and was used for debugging
-void print_dependencies(struct Sheet* sheet) {
-    printf("\n--- Current Dependencies ---\n");
-    for (int i = 0; i < sheet->rows; i++) {
-        for (int j = 0; j < sheet->cols; j++) {
-            char cell_name[10];
-            get_column_name(j + 1, cell_name);
-            printf("%s%d: ", cell_name, i + 1);
-            
-            // Print dependencies
-            printf("depends on: ");
-            DependencyNode* curr = sheet->cells[i][j].depends_on;
-            if (!curr) {
-                printf("none");
-            } else {
-                while (curr) {
-                    char dep_name[10];
-                    get_column_name(curr->col + 1, dep_name);
-                    printf("%s%d ", dep_name, curr->row + 1);
-                    curr = curr->next;
-                }
-            }
-            
-            // Print dependents
-            printf(", dependents: ");
-            curr = sheet->cells[i][j].dependents;
-            if (!curr) {
-                printf("none");
-            } else {
-                while (curr) {
-                    char dep_name[10];
-                    get_column_name(curr->col + 1, dep_name);
-                    printf("%s%d ", dep_name, curr->row + 1);
-                    curr = curr->next;
-                }
-            }
-            printf("\n");
-        }
-    }
-    printf("-------------------------\n\n");
-}
-int setarith(struct Cell* target_cell, int val1, int val2, int opcode) {
-    int result;
-    target_cell->has_error = 0; // Reset error flag
-    
-    switch(opcode) {
-        case 1:  // Addition
-            result = val1 + val2;
-            break;
-        case 2:  // Subtraction
-            result = val1 - val2;
-            break;
-        case 3:  // Multiplication
-            result = val1 * val2;
-            break;
-        case 4:  // Division
-            if(val2 == 0) {
-                target_cell->has_error = 1;  
-                return 1; 
-            }
-            result = val1 / val2;
-            break;
-        default:
-            target_cell->has_error = 1;  
-            return 1;  
-    }
-    
-    target_cell->value = result;
-    return 0;
-}
-
-int setfunc(struct Cell* target_cell, int* values, int count, int opcode) {
-    if (count <= 0) return 1;  
-    
-    int result = 0;
-    double temp = 0;  
-    switch(opcode) {
-        case 1:  // MIN
-            result = values[0];
-            for (int i = 1; i < count; i++) {
-                if (values[i] < result) {
-                    result = values[i];
-                }
-            }
-            break;
-            
-        case 2:  // MAX
-            result = values[0];
-            for (int i = 1; i < count; i++) {
-                if (values[i] > result) {
-                    result = values[i];
-                }
-            }
-            break;
-            
-        case 3:  // AVG
-            for (int i = 0; i < count; i++) {
-                temp += values[i];
-            }
-            result = (int)(temp / count);
-            break;
-            
-        case 4:  // SUM
-            for (int i = 0; i < count; i++) {
-                result += values[i];
-            }
-            break;
-            
-        case 5:  // STDEV
-            result = (int)calculate_stdev(values, count);
-            break;
-            
-        case 6:  // SLEEP
-            if (count != 1) return 1;  
-            sleep(values[0]); 
-            result = values[0];
-            break;
-            
-        default:
-            return 1; 
-    }
-    
-    target_cell->value = result;
-    return 0;
-}
-int evaluate_cell(struct Sheet* sheet, int row, int col) {
-    struct Cell* cell = &sheet->cells[row][col];
-    if (!cell->formula) return 0;
-    
-    cell->has_error = 0;
-    
-    char* formula = strdup(cell->formula);
-    if (!formula) return 1;
-    
-    if (formula[0] >= 'A' && formula[0] <= 'Z' && strchr(formula, '+') == NULL && 
-        strchr(formula, '-') == NULL && strchr(formula, '*') == NULL && 
-        strchr(formula, '/') == NULL && strchr(formula, '(') == NULL) {
-        int source_row = 0, source_col = 0;
-        int i = 0;
-        while (formula[i] >= 'A' && formula[i] <= 'Z') {
-            source_col = source_col * 26 + (formula[i] - 'A' + 1);
-            i++;
-        }
-        source_col--; 
-        source_row = atoi(formula + i) - 1;
-        if (source_row < 0 || source_row >= sheet->rows || 
-            source_col < 0 || source_col >= sheet->cols) {
-            free(formula);
-            cell->has_error = 1;
-            return 1; 
-        }
-        
-        if (sheet->cells[source_row][source_col].has_error) {
-            cell->has_error = 1;
-        } else {
-            cell->value = sheet->cells[source_row][source_col].value;
-        }
-        free(formula);
-        return 0;
-    }
-    char* op_ptr = NULL;
-    if ((op_ptr = strchr(formula, '+')) || 
-        (op_ptr = strchr(formula, '-')) || 
-        (op_ptr = strchr(formula, '*')) || 
-        (op_ptr = strchr(formula, '/'))) {
-        
-        char op = *op_ptr;
-        *op_ptr = '\0'; 
-        
-        char* left = formula;
-        char* right = op_ptr + 1;
-        int val1, val2;
-        int left_has_error = 0, right_has_error = 0;
-        
-        if (left[0] >= 'A' && left[0] <= 'Z') {
-            int source_row = 0, source_col = 0;
-            int i = 0;
-            while (left[i] >= 'A' && left[i] <= 'Z') {
-                source_col = source_col * 26 + (left[i] - 'A' + 1);
-                i++;
-            }
-            source_col--; 
-            source_row = atoi(left + i) - 1; 
-            if (source_row < 0 || source_row >= sheet->rows || 
-                source_col < 0 || source_col >= sheet->cols) {
-                free(formula);
-                cell->has_error = 1;
-                return 1;
-            }
-            
-            if (sheet->cells[source_row][source_col].has_error) {
-                left_has_error = 1;
-            } else {
-                val1 = sheet->cells[source_row][source_col].value;
-            }
-        } else {
-            val1 = atoi(left);
-        }
-        
-        if (right[0] >= 'A' && right[0] <= 'Z') {
-            int source_row = 0, source_col = 0;
-            int i = 0;
-            while (right[i] >= 'A' && right[i] <= 'Z') {
-                source_col = source_col * 26 + (right[i] - 'A' + 1);
-                i++;
-            }
-            source_col--; 
-            source_row = atoi(right + i) - 1; 
-            if (source_row < 0 || source_row >= sheet->rows || 
-                source_col < 0 || source_col >= sheet->cols) {
-                free(formula);
-                cell->has_error = 1;
-                return 1;
-            }
-            
-            if (sheet->cells[source_row][source_col].has_error) {
-                right_has_error = 1;
-            } else {
-                val2 = sheet->cells[source_row][source_col].value;
-            }
-        } else {
-            val2 = atoi(right);
-        }
-        
-        if (left_has_error || right_has_error) {
-            cell->has_error = 1;
-            free(formula);
-            return 0;
-        }
-        
-        int opcode;
-        switch (op) {
-            case '+': opcode = 1; break;
-            case '-': opcode = 2; break;
-            case '*': opcode = 3; break;
-            case '/': opcode = 4; break;
-            default:
-                free(formula);
-                cell->has_error = 1;
-                return 1;
-        }
-        
-        if (setarith(cell, val1, val2, opcode) != 0) {
-            free(formula);
-            return 1;
-        }
-        
-        free(formula);
-        return 0;
-    }
-    char* open_paren = strchr(formula, '(');
-    char* close_paren = strrchr(formula, ')');
-    
-    if (open_paren && close_paren) {
-        int func_len = open_paren - formula;
-        char func_name[16] = {0};
-        strncpy(func_name, formula, func_len);
-        *close_paren = '\0'; 
-        char* args = open_paren + 1;
-        if (strcmp(func_name, "SLEEP") == 0) {
-            int sleep_time;
-            
-            // Check if args is a cell reference
-            if (args[0] >= 'A' && args[0] <= 'Z') {
-                int source_row = 0, source_col = 0;
-                int j = 0;
-                while (args[j] >= 'A' && args[j] <= 'Z') {
-                    source_col = source_col * 26 + (args[j] - 'A' + 1);
-                    j++;
-                }
-                source_col--;
-                source_row = atoi(args + j) - 1;
-                
-                if (source_row < 0 || source_row >= sheet->rows || 
-                    source_col < 0 || source_col >= sheet->cols) {
-                    free(formula);
-                    cell->has_error = 1;
-                    return 1;
-                }
-                
-                if (sheet->cells[source_row][source_col].has_error) {
-                    cell->has_error = 1;
-                    free(formula);
-                    return 0;
-                }
-                
-                sleep_time = sheet->cells[source_row][source_col].value;
-                
-                // Add dependency relationship
-                add_dependency(cell, source_row, source_col);
-                add_dependent(&sheet->cells[source_row][source_col], row, col);
-            } else {
-                sleep_time = atoi(args);
-            }
-            
-            if (sleep_time <= 0) {
-                free(formula);
-                cell->has_error = 1;
-                return 1;
-            }
-            
-            sleep(sleep_time);
-            cell->value = sleep_time;
-            free(formula);
-            return 0;
-        }
-        int opcode;
-        if (strcmp(func_name, "MIN") == 0) opcode = 1;
-        else if (strcmp(func_name, "MAX") == 0) opcode = 2;
-        else if (strcmp(func_name, "AVG") == 0) opcode = 3;
-        else if (strcmp(func_name, "SUM") == 0) opcode = 4;
-        else if (strcmp(func_name, "STDEV") == 0) opcode = 5;
-        else {
-            free(formula);
-            cell->has_error = 1;
-            return 1; 
-        }
-        char* colon = strchr(args, ':');
-        int start_row, start_col, end_row, end_col;
-        int i = 0;
-        start_col = 0;
-        while (args[i] >= 'A' && args[i] <= 'Z') {
-            start_col = start_col * 26 + (args[i] - 'A' + 1);
-            i++;
-        }
-        start_col--; 
-        start_row = atoi(args + i) - 1; 
-        if (colon) {
-            char* end_cell = colon + 1;
-            i = 0;
-            end_col = 0;
-            while (end_cell[i] >= 'A' && end_cell[i] <= 'Z') {
-                end_col = end_col * 26 + (end_cell[i] - 'A' + 1);
-                i++;
-            }
-            end_col--;
-            end_row = atoi(end_cell + i) - 1; 
-        } else {
-            end_row = start_row;
-            end_col = start_col;
-        }
-        if (start_row < 0 || start_row >= sheet->rows || 
-            start_col < 0 || start_col >= sheet->cols ||
-            end_row < 0 || end_row >= sheet->rows ||
-            end_col < 0 || end_col >= sheet->cols ||
-            end_row < start_row || end_col < start_col) {
-            free(formula);
-            cell->has_error = 1;
-            return 1; 
-        }
-        
-        int has_error = 0;
-        for (int r = start_row; r <= end_row; r++) {
-            for (int c = start_col; c <= end_col; c++) {
-                if (sheet->cells[r][c].has_error) {
-                    has_error = 1;
-                    break;
-                }
-            }
-            if (has_error) break;
-        }
-        
-        if (has_error) {
-            cell->has_error = 1;
-            free(formula);
-            return 0;
-        }
-        
-        int rows = end_row - start_row + 1;
-        int cols = end_col - start_col + 1;
-        int count = rows * cols;
-        int* values = malloc(count * sizeof(int));
-        if (!values) {
-            free(formula);
-            cell->has_error = 1;
-            return 1; 
-        }
-        
-        int idx = 0;
-        for (int r = start_row; r <= end_row; r++) {
-            for (int c = start_col; c <= end_col; c++) {
-                values[idx++] = sheet->cells[r][c].value;
-            }
-        }
-        if (setfunc(cell, values, count, opcode) != 0) {
-            free(values);
-            free(formula);
-            cell->has_error = 1;
-            return 1; 
-        }
-        
-        free(values);
-        free(formula);
-        return 0;
-    }
-    
-    free(formula);
-    cell->has_error = 1;
-    return 1; 
-}
-
-void mark_cycle_cells(struct Sheet* sheet, int* in_stack, int rows, int cols) {
-    for (int i = 0; i < rows * cols; i++) {
-        if (in_stack[i]) {
-            int r = i / cols;
-            int c = i % cols;
-            sheet->cells[r][c].has_error = 1;
-        }
-    }
-}
-
-int detect_cycle(struct Sheet* sheet, int row, int col, int* visited, int* in_stack) {
-    int cell_idx = row * sheet->cols + col;
-    
-    if (in_stack[cell_idx]) return 1; // Cycle detected
-    if (visited[cell_idx]) return 0;  // Already visited, no cycle found
-    
-    visited[cell_idx] = 1;
-    in_stack[cell_idx] = 1;
-    
-    DependencyNode* curr = sheet->cells[row][col].depends_on;
-    while (curr) {
-        if (detect_cycle(sheet, curr->row, curr->col, visited, in_stack)) {
-            return 1;  // Propagate cycle detection upward
-        }
-        curr = curr->next;
-    }
-    
-    in_stack[cell_idx] = 0;  // Remove from current path
-    return 0;
-}
-
-void propagate_errors(struct Sheet* sheet, int row, int col, int* visited) {
-    int cell_idx = row * sheet->cols + col;
-    if (visited[cell_idx]) return;
-    
-    visited[cell_idx] = 1;
-    
-    // Mark the cell as error if any of its dependencies has an error
-    DependencyNode* dep = sheet->cells[row][col].depends_on;
-    while (dep) {
-        if (sheet->cells[dep->row][dep->col].has_error) {
-            sheet->cells[row][col].has_error = 1;
-            break;
-        }
-        dep = dep->next;
-    }
-    
-    // Propagate to all cells that depend on this cell
-    DependencyNode* dependent = sheet->cells[row][col].dependents;
-    while (dependent) {
-        propagate_errors(sheet, dependent->row, dependent->col, visited);
-        dependent = dependent->next;
-    }
-}
-
-int update_dependencies(struct Sheet* sheet, int row, int col) {
-    int total_cells = sheet->rows * sheet->cols;
-    int* visited = calloc(total_cells, sizeof(int));
-    int* in_stack = calloc(total_cells, sizeof(int));
-    int* eval_visited = NULL;
-    
-    if (!visited || !in_stack) {
-        free(visited);
-        free(in_stack);
-        return 1;
-    }
-    
-    // First detect cycles starting from the modified cell
-    if (detect_cycle(sheet, row, col, visited, in_stack)) {
-        mark_cycle_cells(sheet, in_stack, sheet->rows, sheet->cols);
-        
-        memset(visited, 0, total_cells * sizeof(int));
-        
-        for (int i = 0; i < total_cells; i++) {
-            if (in_stack[i]) {
-                int r = i / sheet->cols;
-                int c = i % sheet->cols;
-                
-                DependencyNode* dep = sheet->cells[r][c].dependents;
-                while (dep) {
-                    propagate_errors(sheet, dep->row, dep->col, visited);
-                    dep = dep->next;
-                }
-            }
-        }
-    }
-    
-    // Reset visited array for evaluation
-    eval_visited = calloc(total_cells, sizeof(int));
-    if (!eval_visited) {
-        free(visited);
-        free(in_stack);
-        return 1;
-    }
-    
-    void evaluate_dependents(int r, int c) {
-        int idx = r * sheet->cols + c;
-        if (eval_visited[idx]) return;
-        
-        eval_visited[idx] = 1;
-        
-        // If cell has no error, evaluate it
-        if (!sheet->cells[r][c].has_error) {
-            evaluate_cell(sheet, r, c);
-        }
-        
-        // Process all dependents
-        DependencyNode* dep = sheet->cells[r][c].dependents;
-        while (dep) {
-            evaluate_dependents(dep->row, dep->col);
-            dep = dep->next;
-        }
-    }
-    
-    evaluate_dependents(row, col);
-    
-    free(visited);
-    free(in_stack);
-    free(eval_visited);
-    return 0;
-}
-
-void topological_sort_visit(struct Sheet* sheet, int row, int col, int* visited, int** order, int* order_idx) {
-    int cell_idx = row * sheet->cols + col;
-    if (visited[cell_idx]) return;
-    
-    visited[cell_idx] = 1;
-    DependencyNode* curr = sheet->cells[row][col].dependents;
-    while (curr) {
-        if (!visited[curr->row * sheet->cols + curr->col]) {
-            topological_sort_visit(sheet, curr->row, curr->col, visited, order, order_idx);
-        }
-        curr = curr->next;
-    }
-    (*order)[*order_idx * 2] = row;
-    (*order)[*order_idx * 2 + 1] = col;
-    (*order_idx)++;
-}
-
-double sqrt(double x) {
-    if (x <= 0) return 0;
-    double guess = x / 2;
-    double prev;
-    do {
-        prev = guess;
-        guess = (guess + x / guess) / 2;
-    } while (prev - guess > 0.0001 || guess - prev > 0.0001);
-    return guess;
-}
-
-
-void sleep(int seconds) {
-    clock_t end_time = clock() + seconds * CLOCKS_PER_SEC;
-    while (clock() < end_time) {
-        // Busy wait
-    }
-}
-
-int handle_setfunc(struct Sheet* sheet, char* target_cell_ref, char* range_str, int opcode) {
-    int target_row = 0, target_col = 0;
-
-    int i = 0;
-    while(target_cell_ref[i] >= 'A' && target_cell_ref[i] <= 'Z') {
-        target_col = target_col * 26 + (target_cell_ref[i] - 'A' + 1);
-        i++;
-    }
-    target_col--; // Convert to 0-based indexing
-    target_row = atoi(target_cell_ref + i) - 1; // -1 for 0-based indexing
-    
-   
-    if(target_row < 0 || target_row >= sheet->rows || 
-       target_col < 0 || target_col >= sheet->cols) {
-        return 1; 
-    }
-    
-   
-    sheet->cells[target_row][target_col].has_error = 0;
-
-    clear_dependencies(&sheet->cells[target_row][target_col]);
-
-    if (opcode == 6) {  // SLEEP
-        int sleep_time;
-        
-        // Check if range_str is a cell reference
-        if (range_str[0] >= 'A' && range_str[0] <= 'Z') {
-            int source_row = 0, source_col = 0;
-            int j = 0;
-            while (range_str[j] >= 'A' && range_str[j] <= 'Z') {
-                source_col = source_col * 26 + (range_str[j] - 'A' + 1);
-                j++;
-            }
-            source_col--;
-            source_row = atoi(range_str + j) - 1;
-            
-            if (source_row < 0 || source_row >= sheet->rows || 
-                source_col < 0 || source_col >= sheet->cols) {
-                sheet->cells[target_row][target_col].has_error = 1;
-                return 1;
-            }
-            
-            if (sheet->cells[source_row][source_col].has_error) {
-                sheet->cells[target_row][target_col].has_error = 1;
-                return 0;
-            }
-            
-            sleep_time = sheet->cells[source_row][source_col].value;
-            
-            // Add dependency relationship
-            add_dependency(&sheet->cells[target_row][target_col], source_row, source_col);
-            add_dependent(&sheet->cells[source_row][source_col], target_row, target_col);
-        } else {
-            sleep_time = atoi(range_str);
-        }
-        
-        if (sleep_time <= 0) {
-            sheet->cells[target_row][target_col].has_error = 1;
-            return 1;
-        }
-        
-        char formula[256];
-        sprintf(formula, "SLEEP(%s)", range_str);
-        free(sheet->cells[target_row][target_col].formula);
-        sheet->cells[target_row][target_col].formula = strdup(formula);
-        
-        sleep(sleep_time);
-        sheet->cells[target_row][target_col].value = sleep_time;
-        
-        return 0;
-    }
-
-    char* colon = strchr(range_str, ':');
-    int start_row = 0, start_col = 0, end_row = 0, end_col = 0;
-
-    i = 0;
-    while(range_str[i] >= 'A' && range_str[i] <= 'Z') {
-        start_col = start_col * 26 + (range_str[i] - 'A' + 1);
-        i++;
-    }
-    start_col--; 
-    start_row = atoi(range_str + i) - 1;
-
-    if (colon) {
-        char* end_cell = colon + 1;
-        i = 0;
-        while(end_cell[i] >= 'A' && end_cell[i] <= 'Z') {
-            end_col = end_col * 26 + (end_cell[i] - 'A' + 1);
-            i++;
-        }
-        end_col--; 
-        end_row = atoi(end_cell + i) - 1; 
-    } else {
-
-        end_row = start_row;
-        end_col = start_col;
-    }
-
-    if (start_row < 0 || start_row >= sheet->rows || 
-        start_col < 0 || start_col >= sheet->cols ||
-        end_row < 0 || end_row >= sheet->rows ||
-        end_col < 0 || end_col >= sheet->cols ||
-        end_row < start_row || end_col < start_col) {
-        sheet->cells[target_row][target_col].has_error = 1;
-        return 1; 
-    }
-
-    char func_name[10];
-    switch (opcode) {
-        case 1: strcpy(func_name, "MIN"); break;
-        case 2: strcpy(func_name, "MAX"); break;
-        case 3: strcpy(func_name, "AVG"); break;
-        case 4: strcpy(func_name, "SUM"); break;
-        case 5: strcpy(func_name, "STDEV"); break;
-        default: 
-            sheet->cells[target_row][target_col].has_error = 1;
-            return 1; 
-    }
-    
-    char formula[256];
-    sprintf(formula, "%s(%s)", func_name, range_str);
-    free(sheet->cells[target_row][target_col].formula);
-    sheet->cells[target_row][target_col].formula = strdup(formula);
-
-    int has_error_in_range = 0;
-
-    for (int r = start_row; r <= end_row; r++) {
-        for (int c = start_col; c <= end_col; c++) {
-
-            if (sheet->cells[r][c].has_error) {
-                has_error_in_range = 1;
-            }
-            
-            add_dependency(&sheet->cells[target_row][target_col], r, c);
-            add_dependent(&sheet->cells[r][c], target_row, target_col);
-        }
-    }
-    
-
-    if (has_error_in_range) {
-        sheet->cells[target_row][target_col].has_error = 1;
-        update_dependencies(sheet, target_row, target_col);
-        return 0;
-    }
-
-    int rows = end_row - start_row + 1;
-    int cols = end_col - start_col + 1;
-    int count = rows * cols;
-    int* values = malloc(count * sizeof(int));
-    if (!values) {
-        sheet->cells[target_row][target_col].has_error = 1;
-        return 1; 
-    }
-    
-    int idx = 0;
-    for (int r = start_row; r <= end_row; r++) {
-        for (int c = start_col; c <= end_col; c++) {
-            values[idx++] = sheet->cells[r][c].value;
-        }
-    }
-    
-
-    if (setfunc(&sheet->cells[target_row][target_col], values, count, opcode) != 0) {
-        free(values);
-        sheet->cells[target_row][target_col].has_error = 1;
-        update_dependencies(sheet, target_row, target_col);
-        return 1; 
-    }
-    
-    free(values);
-    
-
-    update_dependencies(sheet, target_row, target_col);
-    
-    return 0;
-}
-int setconst(char* cell_ref, char* value, struct Sheet* sheet) {
-    int target_row = 0, target_col = 0;
-    
-    int i = 0;
-    while(cell_ref[i] >= 'A' && cell_ref[i] <= 'Z') {
-        target_col = target_col * 26 + (cell_ref[i] - 'A' + 1);
-        i++;
-    }
-    target_col--;
-    target_row = atoi(cell_ref + i) - 1; 
-    
-    if(target_row < 0 || target_row >= sheet->rows || 
-       target_col < 0 || target_col >= sheet->cols) {
-        return 1; 
-    }
-    
-    sheet->cells[target_row][target_col].has_error = 0;
-    
-    clear_dependencies(&sheet->cells[target_row][target_col]);
-    
-    int val;
-    
-    if(value[0] >= 'A' && value[0] <= 'Z') {
-        int source_row = 0, source_col = 0;
-        i = 0;
-        while(value[i] >= 'A' && value[i] <= 'Z') {
-            source_col = source_col * 26 + (value[i] - 'A' + 1);
-            i++;
-        }
-        source_col--;
-        source_row = atoi(value + i) - 1; 
-        
-        if(source_row < 0 || source_row >= sheet->rows || 
-           source_col < 0 || source_col >= sheet->cols) {
-            sheet->cells[target_row][target_col].has_error = 1;
-            return 1; 
-        }
-        
-        if (sheet->cells[source_row][source_col].has_error) {
-            sheet->cells[target_row][target_col].has_error = 1;
-        } else {
-            val = sheet->cells[source_row][source_col].value;
-            sheet->cells[target_row][target_col].value = val;
-        }
-        
-        add_dependency(&sheet->cells[target_row][target_col], source_row, source_col);
-        add_dependent(&sheet->cells[source_row][source_col], target_row, target_col);
-        
-        free(sheet->cells[target_row][target_col].formula);
-        sheet->cells[target_row][target_col].formula = strdup(value);
-    } else {
-        val = atoi(value);
-        sheet->cells[target_row][target_col].value = val;
-        
-        free(sheet->cells[target_row][target_col].formula);
-        sheet->cells[target_row][target_col].formula = NULL;
-    }
-    
-    update_dependencies(sheet, target_row, target_col);
-    return 0;
-}
-void get_column_name(int col, char* buffer) {
-    // 0-based indexing
-    col--;
-    
-    if (col < 26) {  
-        buffer[0] = 'A' + col;
-        buffer[1] = '\0';
-        return;
-    }
-    
-    // columns after Z
-    int first = col / 26;
-    int second = col % 26;
-    
-    if (first <= 26) {  
-        buffer[0] = 'A' + first - 1;
-        buffer[1] = 'A' + second;
-        buffer[2] = '\0';
-    } else {  
-        int third = second;
-        second = first % 26;
-        first = first / 26;
-        buffer[0] = 'A' + first - 1;
-        buffer[1] = 'A' + second - 1;
-        buffer[2] = 'A' + third;
-        buffer[3] = '\0';
-    }
-}
-
-int display(struct Sheet* sheet) {
- 
-    if (sheet->suppress_output) {
-        return 0;
-    }
-    
-    char col_name[4];
-    
-
-    int end_row = sheet->view_row + 10;
-    int end_col = sheet->view_col + 10;
-    if (end_row > sheet->rows) end_row = sheet->rows;
-    if (end_col > sheet->cols) end_col = sheet->cols;
-    
-
-    printf("    ");
-    for(int j = sheet->view_col; j < end_col; j++) {
-        get_column_name(j + 1, col_name);
-        printf("%-4s ", col_name);
-    }
-    printf("\n");
-    
-
-    for(int i = sheet->view_row; i < end_row; i++) {
-        printf("%-3d ", i + 1);
-        for(int j = sheet->view_col; j < end_col; j++) {
-            if (sheet->cells[i][j].has_error) {
-                printf("ERR  ");
-            } else {
-                printf("%-4d ", sheet->cells[i][j].value);
-            }
-        }
-        printf("\n");
-    }
-    return 0;
-}
-int scroll_to(struct Sheet* sheet, char* cell_ref) {
-    int target_row = 0, target_col = 0;
-    
-    int i = 0;
-    while (cell_ref[i] >= 'A' && cell_ref[i] <= 'Z') {
-        target_col = target_col * 26 + (cell_ref[i] - 'A' + 1);
-        i++;
-    }
-    target_col--; 
-    target_row = atoi(cell_ref + i) - 1;
-
-    if (target_row < 0 || target_row >= sheet->rows || 
-        target_col < 0 || target_col >= sheet->cols) {
-        return 1; 
-    }
-
-    sheet->view_row = target_row;
-    sheet->view_col = target_col;
-    
-    return 0;
-}
-
-int control(char* input, struct Sheet* sheet) {
-    switch (input[0]) {
-        case 'w':  
-            if (sheet->view_row >= 10) {
-                sheet->view_row -= 10;  
-            } else {
-                sheet->view_row = 0;  
-            }
-            break;
-
-        case 's': 
-            if (sheet->view_row + 20 <= sheet->rows) {
-                sheet->view_row += 10;  
-            } else if (sheet->rows > 10) {
-                sheet->view_row = sheet->rows - 10;  
-            }
-            break;
-
-        case 'a':  
-            if (sheet->view_col >= 10) {
-                sheet->view_col -= 10;  
-            } else {
-                sheet->view_col = 0;  
-            }
-            break;
-
-        case 'd':
-            if (sheet->view_col + 20 <= sheet->cols) {
-                sheet->view_col += 10; 
-            } else if (sheet->cols > 10) {
-                sheet->view_col = sheet->cols - 10;  
-            }
-            break;
-
-        default: 
-            return 1;
-    }
-    return 0; 
-}
-int handle_setarith(struct Sheet* sheet, char* target_cell_ref, char* left_operand, char* right_operand, char op) {
-    int target_row = 0, target_col = 0;
-
-    int i = 0;
-    while(target_cell_ref[i] >= 'A' && target_cell_ref[i] <= 'Z') {
-        target_col = target_col * 26 + (target_cell_ref[i] - 'A' + 1);
-        i++;
-    }
-    target_col--; 
-    target_row = atoi(target_cell_ref + i) - 1; 
-
-    if(target_row < 0 || target_row >= sheet->rows || 
-       target_col < 0 || target_col >= sheet->cols) {
-        return 1; 
-    }
-    
-    sheet->cells[target_row][target_col].has_error = 0;
-    
-    clear_dependencies(&sheet->cells[target_row][target_col]);
-
-    int val1, val2;
-    int left_row = -1, left_col = 0;  
-    int right_row = -1, right_col = 0;  
-    int left_has_error = 0, right_has_error = 0;
-    
-    if(left_operand[0] >= 'A' && left_operand[0] <= 'Z') {
-        i = 0;
-        while(left_operand[i] >= 'A' && left_operand[i] <= 'Z') {
-            left_col = left_col * 26 + (left_operand[i] - 'A' + 1);
-            i++;
-        }
-        left_col--;
-        left_row = atoi(left_operand + i) - 1;
-        if(left_row < 0 || left_row >= sheet->rows || left_col < 0 || left_col >= sheet->cols) {
-            sheet->cells[target_row][target_col].has_error = 1;
-            return 1;
-        }
-        
-        if (sheet->cells[left_row][left_col].has_error) {
-            left_has_error = 1;
-        } else {
-            val1 = sheet->cells[left_row][left_col].value;
-        }
-        
-        add_dependency(&sheet->cells[target_row][target_col], left_row, left_col);
-        add_dependent(&sheet->cells[left_row][left_col], target_row, target_col);
-    } else {
-        val1 = atoi(left_operand);
-    }
-    
-    if(right_operand[0] >= 'A' && right_operand[0] <= 'Z') {
-        i = 0;
-        while(right_operand[i] >= 'A' && right_operand[i] <= 'Z') {
-            right_col = right_col * 26 + (right_operand[i] - 'A' + 1);
-            i++;
-        }
-        right_col--;
-        right_row = atoi(right_operand + i) - 1;
-        if(right_row < 0 || right_row >= sheet->rows || right_col < 0 || right_col >= sheet->cols) {
-            sheet->cells[target_row][target_col].has_error = 1;
-            return 1; 
-        }
-        
-        if (sheet->cells[right_row][right_col].has_error) {
-            right_has_error = 1;
-        } else {
-            val2 = sheet->cells[right_row][right_col].value;
-        }
-        
-        add_dependency(&sheet->cells[target_row][target_col], right_row, right_col);
-        add_dependent(&sheet->cells[right_row][right_col], target_row, target_col);
-    } else {
-        val2 = atoi(right_operand);
-    }
-    
-    char formula[256];
-    sprintf(formula, "%s%c%s", left_operand, op, right_operand);
-    free(sheet->cells[target_row][target_col].formula);
-    sheet->cells[target_row][target_col].formula = strdup(formula);
-    
-    if (left_has_error || right_has_error) {
-        sheet->cells[target_row][target_col].has_error = 1;
-        update_dependencies(sheet, target_row, target_col);
-        return 0;
-    }
-    
-    int opcode;
-    switch(op) {
-        case '+': opcode = 1; break;
-        case '-': opcode = 2; break;
-        case '*': opcode = 3; break;
-        case '/': opcode = 4; break;
-        default: 
-            sheet->cells[target_row][target_col].has_error = 1;
-            update_dependencies(sheet, target_row, target_col);
-            return 1; 
-    }
-    
-    if (opcode == 4 && val2 == 0) {
-        sheet->cells[target_row][target_col].has_error = 1;
-        update_dependencies(sheet, target_row, target_col);
-        return 1;
-    }
-    
-    if (setarith(&sheet->cells[target_row][target_col], val1, val2, opcode) != 0) {
-        update_dependencies(sheet, target_row, target_col);
-        return 1; 
-    }
-    
-    update_dependencies(sheet, target_row, target_col);
-    return 0;
-}
-struct Command* parse_input(char* input) {
-    if (input != NULL) {
-        input[strcspn(input, "\r\n")] = '\0';
-    }
-    if (input == NULL || input[0] == '\0') {
-        struct Command* cmd = malloc(sizeof(struct Command));
-        if(cmd != NULL) {
-            for (int i = 0; i < 4; i++)
-                cmd->args[i] = NULL;
-            cmd->type = CMD_INVALID;
-        }
-        return cmd;
-    }
-    struct Command* cmd = malloc(sizeof(struct Command));
-    if (cmd == NULL) return NULL;
-    
-    for(int i = 0; i < 4; i++) {
-        cmd->args[i] = NULL;
-    }
-    if (strcmp(input, "disable_output") == 0) {
-        cmd->type = CMD_DISABLE_OUTPUT;
-        return cmd;
-    }
-    
-    if (strcmp(input, "enable_output") == 0) {
-        cmd->type = CMD_ENABLE_OUTPUT;
-        return cmd;
-    }
-    if (strncmp(input, "scroll_to ", 10) == 0) {
-        cmd->type = CMD_SCROLL_TO;
-        cmd->args[0] = strdup(input + 10); 
-        return cmd;
-    }
-    if (strlen(input) == 1) {
-        switch(input[0]) {
-            case 'w':
-            case 'a':
-            case 's':
-            case 'd':
-            case 'q':
-                cmd->type = CMD_CONTROL;
-                cmd->args[0] = malloc(strlen(input) + 1);
-                if (cmd->args[0] != NULL) {
-                    strcpy(cmd->args[0], input);
-                }
-                return cmd;
-        }
-    }
-    char* equals = strchr(input, '=');
-    if (equals != NULL) {
-        *equals = '\0';  
-        char* cell = input;
-        char* value = equals + 1;
-        while(*cell && isspace(*cell)) cell++;
-        while(*value && isspace(*value)) value++;
-        char* end = cell + strlen(cell) - 1;
-        while(end > cell && isspace(*end)) *end-- = '\0';
-        end = value + strlen(value) - 1;
-        while(end > value && isspace(*end)) *end-- = '\0';
-        char* open_paren = strchr(value, '(');
-        char* close_paren = strchr(value, ')');
-        if (open_paren && close_paren && open_paren < close_paren) {
-            int func_len = open_paren - value;
-            char func_name[10] = {0};  
-            strncpy(func_name, value, func_len);
-            char* arg = open_paren + 1;
-            *close_paren = '\0';
-            
-            cmd->type = CMD_SETFUNC;
-            cmd->args[0] = strdup(cell);     
-            
-            if (strcmp(func_name, "SLEEP") == 0) {
-                cmd->args[1] = strdup(arg);
-                cmd->args[2] = strdup("6");
-                return cmd;
-            }
-
-            cmd->args[1] = strdup(arg);
-
-
-            if (strcmp(func_name, "MIN") == 0) cmd->args[2] = strdup("1");
-            else if (strcmp(func_name, "MAX") == 0) cmd->args[2] = strdup("2");
-            else if (strcmp(func_name, "AVG") == 0) cmd->args[2] = strdup("3");
-            else if (strcmp(func_name, "SUM") == 0) cmd->args[2] = strdup("4");
-            else if (strcmp(func_name, "STDEV") == 0) cmd->args[2] = strdup("5");
-            else {
-                cmd->type = CMD_INVALID;
-                return cmd;
-            }
-            return cmd;
-        }
-        char* operator = strpbrk(value, "+-*/");
-        if (operator != NULL) {
-
-            char opcode = *operator;
-            *operator = '\0';  
-            
-            cmd->type = CMD_SETARITH;
-            cmd->args[0] = malloc(strlen(cell) + 1);
-            cmd->args[1] = malloc(strlen(value) + 1);
-            cmd->args[2] = malloc(strlen(operator+1)+1);
-            cmd->args[3] = malloc(2); 
-            
-            if(cmd->args[0] && cmd->args[1] && cmd->args[2] && cmd->args[3]) {
-                strcpy(cmd->args[0], cell);    
-                strcpy(cmd->args[1], value);   
-                strcpy(cmd->args[2], operator + 1); 
-                
-
-                cmd->args[3][0]= opcode;
-                cmd->args[3][1] = '\0';
-                return cmd;
-            } else {
-                printf("Memory allocation failed\n");
-                free(cmd->args[0]);
-                free(cmd->args[1]);
-                free(cmd->args[2]);
-                free(cmd->args[3]);
-                cmd->args[0] = cmd->args[1] = cmd->args[2]= cmd->args[3] = NULL;
-                cmd->type = CMD_INVALID;
-                *operator = opcode;
-                
-                return cmd;
-            }
-        } else if (strlen(value) > 0) {
-            cmd->type = CMD_SETCONST;
-            cmd->args[0] = malloc(strlen(cell) + 1);
-            cmd->args[1] = malloc(strlen(value) + 1);
-            if (cmd->args[0] && cmd->args[1]) {
-                strcpy(cmd->args[0], cell);
-                strcpy(cmd->args[1], value);
-                return cmd;
-            }
-        }
-    }
- 
-    cmd->type = CMD_INVALID;
-    return cmd;
-}
-int main(int argc, char *argv[]) {
-    struct Sheet* sheet = NULL;
-    int state = 0;  // Will store this in sheet later
-    char input[1024];
- 
-    if (state == 0) {
-        if (argc != 3) {
-            printf("Usage: ./sheet <rows> <cols>\n"); 
-            return 1;
-        }
- 
-        sheet = malloc(sizeof(struct Sheet));
-        if (sheet == NULL) {
-            printf("Memory allocation failed\n");
-            return 1;
-        }
- 
-        sheet->rows = atoi(argv[1]);
-        sheet->cols = atoi(argv[2]);
-        sheet->view_row = 0;
-        sheet->view_col = 0;
-        sheet->suppress_output = 0; 
-        sheet->cells = malloc(sheet->rows * sizeof(struct Cell*));
-        if (sheet->cells == NULL) {
-            free(sheet);
-            printf("Memory allocation failed\n");
-            return 1;
-        }
-        for (int i = 0; i < sheet->rows; i++) {
-            sheet->cells[i] = malloc(sheet->cols * sizeof(struct Cell));
-            if (sheet->cells[i] == NULL) {
-                for (int j = 0; j < i; j++) {
-                    free(sheet->cells[j]);
-                }
-                free(sheet->cells);
-                free(sheet);
-                printf("Memory allocation failed\n");
-                return 1;
-            }
-            for (int j = 0; j < sheet->cols; j++) {
-                sheet->cells[i][j].value = 0;
-                sheet->cells[i][j].formula = NULL;
-                sheet->cells[i][j].depends_on = NULL;
-                sheet->cells[i][j].dependents = NULL;
-                sheet->cells[i][j].has_error = 0; 
-            }
-        }
-        
-        state = 1;
-        display(sheet);  
-    }
-
-    while(state == 1) {
-        printf("> ");
-        
-        if (fgets(input, sizeof(input), stdin) == NULL) {
-            break;
-        }
-        input[strcspn(input, "\n")] = 0;
- 
-        struct Command* cmd = parse_input(input);
-        if (cmd == NULL) {
-            printf("Memory allocation failed\n");
-            continue;
-        }
-        switch(cmd->type) {
-            case CMD_CONTROL:
-                if (cmd->args[0][0] == 'q') {
-                    state = 0;  
-                }
-                else {
-                    control(cmd->args[0], sheet);
-                    if (!sheet->suppress_output) {
-                        display(sheet);
-                    }
-                }
-                break;
- 
-            case CMD_SETCONST:
-                if (setconst(cmd->args[0], cmd->args[1], sheet) != 0) {
-                    printf("Invalid cell reference or value\n");
-                }
-                if (!sheet->suppress_output) {
-                    display(sheet);
-                }
-                break;
-                
-            case CMD_SETARITH:
-                if (handle_setarith(sheet, cmd->args[0], cmd->args[1], cmd->args[2], cmd->args[3][0]) != 0) {
-                    printf("Arithmetic error (division-by-zero, or invalid reference)\n");
-                }
-                if (!sheet->suppress_output) {
-                    display(sheet);
-                }
-                break;
-               
-            case CMD_SETFUNC:
-                if (handle_setfunc(sheet, cmd->args[0], cmd->args[1], atoi(cmd->args[2])) != 0) {
-                    printf("Error applying function to range\n");
-                }
-                if (!sheet->suppress_output) {
-                    display(sheet);
-                }
-                break;
-                
-            case CMD_DISABLE_OUTPUT:
-                sheet->suppress_output = 1;
-                break;
-                
-            case CMD_ENABLE_OUTPUT:
-                if (sheet->suppress_output) {
-                    sheet->suppress_output = 0;
-                    
-                }
-                break;
-                
-            case CMD_SCROLL_TO:
-                if (scroll_to(sheet, cmd->args[0]) != 0) {
-                    printf("Invalid cell reference for scroll_to\n");
-                }
-                if (!sheet->suppress_output) {
-                    display(sheet);
-                }
-                break;
-                
-            case CMD_INVALID:
-                printf("Invalid command\n");
-                break;
-        }
-        for(int i = 0; i < 4; i++) {
-            free(cmd->args[i]);
-        }
-        free(cmd);
-    }
-    if (sheet) {
-        if (sheet->cells) {
-            for (int i = 0; i < sheet->rows; i++) {
-                if (sheet->cells[i]) {
-                    for (int j = 0; j < sheet->cols; j++) {
-                        free(sheet->cells[i][j].formula);
-                        DependencyNode* curr = sheet->cells[i][j].depends_on;
-                        while (curr) {
-                            DependencyNode* temp = curr;
-                            curr = curr->next;
-                            free(temp);
-                        }
-                        
-                        curr = sheet->cells[i][j].dependents;
-                        while (curr) {
-                            DependencyNode* temp = curr;
-                            curr = curr->next;
-                            free(temp);
-                        }
-                    }
-                    free(sheet->cells[i]);
-                }
-            }
-            free(sheet->cells);
-        }
-        free(sheet);
-    }
-    
-    return 0;
- }
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE
+#include<string.h>
+#include<stdio.h>
+#include<stdlib.h>
+#include<stddef.h>
+#include<ctype.h>
+#include<math.h>
+#include<time.h>
+#include<sys/mman.h>
+#if defined(__x86_64__)
+#include<immintrin.h>
+#endif
+
+struct Sheet;
+struct Cell;
+
+int setarith(struct Sheet* sheet, int idx, int val1, int val2, int opcode);
+void sleep(int seconds);
+void get_column_name(int col, char* buffer);
+
+
+// Open-addressing hash set of cell indices (row * cols + col)
+#define CELLSET_EMPTY -1
+#define CELLSET_DELETED -2
+#define CELLSET_MIN_CAPACITY 4
+
+typedef struct CellSet {
+    int* slots;     // cell index, CELLSET_EMPTY or CELLSET_DELETED
+    int count;      // live entries
+    int used;       // live entries plus tombstones
+    int capacity;   // power of two, 0 until the first insert
+} CellSet;
+
+// One edge per range reference, not expanded into per-cell nodes
+typedef struct RangeDependency {
+    int row;
+    int col;
+    int start_row;
+    int start_col;
+    int end_row;
+    int end_col;
+    struct RTreeNode* leaf;   // index node holding this edge
+    struct RangeAggregate* aggregate;  // running state of an aggregate, or NULL
+} RangeDependency;
+
+// R-tree over the rectangles of all range edges
+#define RTREE_MAX_ENTRIES 8
+#define RTREE_MIN_ENTRIES 3
+#define RTREE_STACK_SIZE 512
+#define RTREE_MAX_HEIGHT 32   // every non-root node holds RTREE_MIN_ENTRIES or more
+
+typedef struct RTreeNode {
+    int is_leaf;
+    int count;
+    int bounds[RTREE_MAX_ENTRIES + 1][4];  // start_row, start_col, end_row, end_col
+    void* entries[RTREE_MAX_ENTRIES + 1];  // child nodes, or RangeDependency* in leaves
+    struct RTreeNode* parent;
+} RTreeNode;
+
+typedef struct RangeList {
+    RangeDependency** items;
+    int count;
+    int capacity;
+} RangeList;
+
+// CSR copy of the point dependents built by "freeze", stale cells read live
+#define CSR_MAX_STALE 1024
+
+typedef struct DependentsCSR {
+    int* cells;       // packed cells in index order, NULL while thawed
+    int* offsets;     // cell_count + 1 entries into targets
+    int* targets;
+    int cell_count;
+    int edge_count;
+    CellSet stale;
+} DependentsCSR;
+
+// Growable stack of cell indices shared by the graph traversals
+typedef struct Worklist {
+    int* items;
+    int count;
+    int capacity;
+} Worklist;
+
+// Per-block totals, squares, error counts and min/max of one column
+#define COLUMN_INDEX_MIN_RANGES 8
+
+typedef struct ColumnBlock {
+    long long total;
+    __int128 squares;
+    int errors;
+} ColumnBlock;
+
+typedef struct ColumnIndex {
+    int blocks;             // blocks of the column, 0 while it is all zero
+    long long* sums;        // 1-based Fenwick tree of block totals
+    __int128* squares;      // 1-based Fenwick tree of block sums of squares
+    int* errors;            // 1-based Fenwick tree of block error counts
+    int* lows;              // segment tree of block minima, leaves at [blocks, 2 * blocks)
+    int* highs;             // segment tree of block maxima
+    ColumnBlock* held;      // per block: what the trees currently hold
+    unsigned char* queued;  // per block: on the pending list
+    Worklist pending;       // blocks queued since the last query
+} ColumnIndex;
+
+// Executable pages of fixed-size slots for compiled formulas
+#define JIT_SLOT_SIZE 128
+#define JIT_CHUNK_SLOTS 512
+#define JIT_BATCH_SIZE 256
+
+typedef int (*JitFunction)(void);
+
+typedef struct JitArena {
+    int enabled;
+    unsigned char** chunks;
+    unsigned char* writable;  // chunk is mapped read-write during a flush
+    int chunk_count;
+    int next_slot;     // first never-used slot
+    int* free_slots;
+    int free_count;
+    int free_capacity;
+    Worklist pending;  // cells waiting to be compiled
+} JitArena;
+
+// Formula compiled at assignment, with coordinates relative to its own cell
+enum FormulaKind {
+    FORMULA_REF,    // copy of another cell
+    FORMULA_ARITH,  // left op right, opcode as for setarith
+    FORMULA_FUNC,   // range function, opcode as for setfunc
+    FORMULA_SLEEP   // SLEEP of a cell or a constant
+};
+
+typedef struct Operand {
+    int is_cell;
+    int row;    // offsets from the formula's cell when is_cell
+    int col;
+    int value;  // the constant otherwise
+} Operand;
+
+typedef struct Formula {
+    enum FormulaKind kind;
+    int opcode;
+    Operand left;   // REF and SLEEP only use left
+    Operand right;
+    int start_row, start_col, end_row, end_col;  // FUNC range, relative
+} Formula;
+
+#define FORMULA_EMPTY -1
+#define FORMULA_DELETED -2
+
+// Interned formulas by content; an id is recycled once no cell uses it
+typedef struct FormulaTable {
+    Formula* items;
+    int* refs;           // cells using each id
+    int count;           // ids handed out so far
+    int capacity;
+    Worklist free_ids;
+    int* buckets;        // FORMULA_EMPTY, FORMULA_DELETED or an id
+    int bucket_capacity;
+    int bucket_used;     // ids plus deleted markers
+} FormulaTable;
+
+// MIN/MAX over at least this many cells indexes every column it covers
+#define RANGE_TREE_MIN_CELLS 64
+
+// Running moments of a rectangle, shared by every SUM, AVG and STDEV over it
+typedef struct RangeAggregate {
+    int bounds[4];          // start_row, start_col, end_row, end_col
+    int refs;               // ranges sharing the state
+    unsigned int stamp;     // Kahn step that last updated it
+    int valid;              // the state matches the range
+    int errors;             // cells of the range in error
+    long long total;        // sum of the range's values
+    __int128 squares;       // sum of the squared values
+    struct RangeAggregate* next;  // hash chain
+} RangeAggregate;
+
+typedef struct AggregateTable {
+    RangeAggregate** buckets;
+    int count;
+    int capacity;   // power of two, 0 until the first insert
+} AggregateTable;
+
+// Formula and graph state of a cell; values and errors live in the tiles
+struct Cell {
+    int formula;    // id in the sheet's formula table, -1 for a constant
+    struct CellSet depends_on;    
+    struct CellSet dependents;    
+    struct RangeDependency* depends_on_range;
+    int rank;       // position in the dynamic topological order, 0 until placed
+    int ranked;     // rank is maintained for this cell's edges
+    int cyclic;     // the cell's formula closes a cycle
+    int rank_mark;  // RANK_* flags while the order is being repaired
+    unsigned int dirty_epoch;  // sheet epoch in which the cell was last dirtied
+    int in_degree;             // dirty precedents not yet recalculated
+    int input_changed;         // a precedent changed during this recalculation
+    int jit_slot;              // native code for the formula, -1 if interpreted
+    int batch_pos;             // Kahn queue index + 1 while waiting in a run
+    int csr_row;               // entry in the frozen CSR, if its cells agree
+};
+
+enum CommandType {
+    CMD_CONTROL, 
+    CMD_SETCONST,    
+    CMD_SETARITH,
+    CMD_SETFUNC,   
+    CMD_DISABLE_OUTPUT, 
+    CMD_ENABLE_OUTPUT,  
+    CMD_SCROLL_TO,    
+    CMD_FREEZE,
+    CMD_THAW,
+    CMD_ENABLE_JIT,
+    CMD_DISABLE_JIT,
+    CMD_INVALID     
+};
+
+struct Command {
+    enum CommandType type;
+    char* args[4];  
+ };
+// Widest supported kernels over one row run of the value plane
+typedef struct RangeKernels {
+    void (*extreme)(const int* values, int count, int opcode, int* extreme);
+    void (*moments)(const int* values, int count, long long* total, __int128* squares);
+} RangeKernels;
+
+// The grid is stored as square tiles of TILE_SIZE x TILE_SIZE cells
+#define TILE_SHIFT 6
+#define TILE_SIZE (1 << TILE_SHIFT)
+#define TILE_MASK (TILE_SIZE - 1)
+
+// Row r of a tile: values[r * TILE_SIZE ...], bit c of errors[r] and of ranked[r]
+typedef struct Tile {
+    int values[TILE_SIZE * TILE_SIZE];
+    unsigned long long errors[TILE_SIZE];
+    unsigned long long ranked[TILE_SIZE];
+} Tile;
+
+// Cell records are paged by index, so reaching one needs no division
+#define RECORD_PAGE_SHIFT 8
+#define RECORD_PAGE_SIZE (1 << RECORD_PAGE_SHIFT)
+
+struct Sheet {
+    Tile** tiles;                   // row-major tile grid, NULL until written
+    int tile_rows;
+    int tile_cols;
+    unsigned long long col_magic;   // idx / cols == idx * col_magic >> col_shift
+    int col_shift;
+    Tile empty;                     // what an unwritten tile reads as
+    struct Cell*** records;         // pages of per-cell records, NULL until needed
+    int record_pages;
+    struct Cell blank;              // what a cell without a record reads as
+    int rows;
+    int cols;
+    int view_row;  
+    int view_col;  
+    int suppress_output;  
+    struct RTreeNode* range_index;  // all range edges, for reverse lookup
+    struct RangeList range_hits;    // scratch results of range_index queries
+    struct Worklist worklist;       // scratch stack for graph traversals
+    struct CellSet cyclic_cells;    // formulas currently closing a cycle
+    struct Worklist rank_forward;   // cells reordered after the new edge
+    struct Worklist rank_backward;  // cells reordered before the new edge
+    struct Worklist rank_touched;   // cells whose rank_mark must be reset
+    struct Worklist ranked_hits;    // scratch results of find_ranked_in_range
+    int rank_low;                   // lowest rank handed out so far
+    int rank_high;                  // highest rank handed out so far
+    unsigned int epoch;             // bumped once per recalculation
+    struct Worklist dirty;          // cells reached by the current recalculation
+    struct Worklist order;          // Kahn queue of the current recalculation
+    struct DependentsCSR frozen;    // packed dependents while frozen
+    struct JitArena jit;            // native code for simple formulas
+    struct FormulaTable formulas;   // interned relative formulas
+    struct Worklist changed;        // per Kahn queue entry: RECALC_* flags
+    struct Worklist old_values;     // per Kahn queue entry: value before recalc
+    int edit_pending;               // the edit below has not been recalculated
+    int edit_row;
+    int edit_col;
+    int edit_value;                 // result of the edited cell before the edit
+    int edit_error;
+    int* column_ranges;             // per column: distinct range states covering it
+    struct ColumnIndex** columns;   // per column: its index, or NULL
+    AggregateTable aggregates;      // range states by rectangle
+    unsigned int aggregate_stamp;
+    RangeKernels kernels;
+};
+
+// Hot values and error bits live in lazily allocated tiles, the rest in cold records
+Tile* tile_peek(struct Sheet* sheet, int row, int col) {
+    Tile* tile = sheet->tiles[(row >> TILE_SHIFT) * sheet->tile_cols + (col >> TILE_SHIFT)];
+    return tile ? tile : &sheet->empty;
+}
+
+// Tile holding (row, col), allocated on first use
+Tile* tile_at(struct Sheet* sheet, int row, int col) {
+    Tile** slot = &sheet->tiles[(row >> TILE_SHIFT) * sheet->tile_cols + (col >> TILE_SHIFT)];
+    if (!*slot) {
+        *slot = calloc(1, sizeof(Tile));
+        if (!*slot) {
+            printf("Memory allocation failed\n");
+            exit(1);
+        }
+    }
+    return *slot;
+}
+
+// Row and column of idx by multiply-shift, exact for cell indices only
+void cell_coords(struct Sheet* sheet, int idx, int* row, int* col) {
+    *row = (int)(((unsigned long long)(unsigned int)idx * sheet->col_magic) >> sheet->col_shift);
+    *col = idx - *row * sheet->cols;
+}
+
+int tile_offset(int row, int col) {
+    return (row & TILE_MASK) * TILE_SIZE + (col & TILE_MASK);
+}
+
+int value_at(struct Sheet* sheet, int row, int col) {
+    return tile_peek(sheet, row, col)->values[tile_offset(row, col)];
+}
+
+void set_value_at(struct Sheet* sheet, int row, int col, int value) {
+    Tile* tile = tile_peek(sheet, row, col);
+    if (tile == &sheet->empty) {
+        if (value == 0) return;
+        tile = tile_at(sheet, row, col);
+    }
+    tile->values[tile_offset(row, col)] = value;
+}
+
+int error_at(struct Sheet* sheet, int row, int col) {
+    return (tile_peek(sheet, row, col)->errors[row & TILE_MASK] >> (col & TILE_MASK)) & 1;
+}
+
+void set_error_at(struct Sheet* sheet, int row, int col, int error) {
+    Tile* tile = tile_peek(sheet, row, col);
+    unsigned long long bit = 1ULL << (col & TILE_MASK);
+    if (error) {
+        if (tile == &sheet->empty) tile = tile_at(sheet, row, col);
+        tile->errors[row & TILE_MASK] |= bit;
+    } else if (tile != &sheet->empty) {
+        tile->errors[row & TILE_MASK] &= ~bit;
+    }
+}
+
+int cell_value(struct Sheet* sheet, int idx) {
+    int row, col;
+    cell_coords(sheet, idx, &row, &col);
+    return value_at(sheet, row, col);
+}
+
+void set_cell_value(struct Sheet* sheet, int idx, int value) {
+    int row, col;
+    cell_coords(sheet, idx, &row, &col);
+    set_value_at(sheet, row, col, value);
+}
+
+int cell_error(struct Sheet* sheet, int idx) {
+    int row, col;
+    cell_coords(sheet, idx, &row, &col);
+    return error_at(sheet, row, col);
+}
+
+void set_cell_error(struct Sheet* sheet, int idx, int error) {
+    int row, col;
+    cell_coords(sheet, idx, &row, &col);
+    set_error_at(sheet, row, col, error);
+}
+
+// Storage of the value of idx, which stays put for the life of the sheet
+int* value_slot(struct Sheet* sheet, int idx) {
+    int row, col;
+    cell_coords(sheet, idx, &row, &col);
+    return &tile_at(sheet, row, col)->values[tile_offset(row, col)];
+}
+
+// Bitmap word holding the error flag of idx, as bit idx % cols % TILE_SIZE
+unsigned long long* error_word(struct Sheet* sheet, int idx) {
+    int row, col;
+    cell_coords(sheet, idx, &row, &col);
+    return &tile_at(sheet, row, col)->errors[row & TILE_MASK];
+}
+
+// Contiguous values of row from col to end_col or the tile edge, returns the count
+int value_run(struct Sheet* sheet, int row, int col, int end_col, const int** run) {
+    int count = TILE_SIZE - (col & TILE_MASK);
+    if (count > end_col - col + 1) count = end_col - col + 1;
+    *run = &tile_peek(sheet, row, col)->values[tile_offset(row, col)];
+    return count;
+}
+
+// Error bits of row from col to end_col or the tile edge, count in *count
+unsigned long long error_run(struct Sheet* sheet, int row, int col, int end_col, int* count) {
+    int n = TILE_SIZE - (col & TILE_MASK);
+    if (n > end_col - col + 1) n = end_col - col + 1;
+    unsigned long long word = tile_peek(sheet, row, col)->errors[row & TILE_MASK] >> (col & TILE_MASK);
+    *count = n;
+    return n < 64 ? word & ((1ULL << n) - 1) : word;
+}
+
+// Cells of row in [col, col + count) in error, one bitmap word per tile
+int count_errors(struct Sheet* sheet, int row, int col, int count) {
+    int errors = 0;
+    int end_col = col + count - 1;
+    while (col <= end_col) {
+        int n;
+        errors += __builtin_popcountll(error_run(sheet, row, col, end_col, &n));
+        col += n;
+    }
+    return errors;
+}
+
+// Whether any cell of row in [col, col + count) is in error
+int any_errors(struct Sheet* sheet, int row, int col, int count) {
+    int end_col = col + count - 1;
+    while (col <= end_col) {
+        int n;
+        if (error_run(sheet, row, col, end_col, &n)) return 1;
+        col += n;
+    }
+    return 0;
+}
+
+// Whether the tile holding (row, col) has been written to
+int tile_present(struct Sheet* sheet, int row, int col) {
+    return sheet->tiles[(row >> TILE_SHIFT) * sheet->tile_cols + (col >> TILE_SHIFT)] != NULL;
+}
+
+// Whether any cell of the rectangle is in error, from its present tiles' bitmaps
+int range_has_error(struct Sheet* sheet, int start_row, int start_col, int end_row, int end_col) {
+    for (int tr = start_row; tr <= end_row; tr = (tr | TILE_MASK) + 1) {
+        int tile_end_row = (tr | TILE_MASK) < end_row ? (tr | TILE_MASK) : end_row;
+        for (int tc = start_col; tc <= end_col; tc = (tc | TILE_MASK) + 1) {
+            if (!tile_present(sheet, tr, tc)) continue;
+            int width = ((tc | TILE_MASK) < end_col ? (tc | TILE_MASK) : end_col) - tc + 1;
+            for (int r = tr; r <= tile_end_row; r++) {
+                if (any_errors(sheet, r, tc, width)) return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+void cell_init(struct Cell* cell) {
+    cell->formula = -1;
+    cell->depends_on = (CellSet){NULL, 0, 0, 0};
+    cell->dependents = (CellSet){NULL, 0, 0, 0};
+    cell->depends_on_range = NULL;
+    cell->rank = 0;
+    cell->ranked = 0;
+    cell->cyclic = 0;
+    cell->rank_mark = 0;
+    cell->dirty_epoch = 0;
+    cell->in_degree = 0;
+    cell->input_changed = 0;
+    cell->jit_slot = -1;
+    cell->batch_pos = 0;
+    cell->csr_row = -1;
+}
+
+// Record of idx for reading only
+struct Cell* cell_peek(struct Sheet* sheet, int idx) {
+    struct Cell** page = sheet->records[idx >> RECORD_PAGE_SHIFT];
+    struct Cell* cell = page ? page[idx & (RECORD_PAGE_SIZE - 1)] : NULL;
+    return cell ? cell : &sheet->blank;
+}
+
+struct Cell* cell_create(struct Sheet* sheet, int idx) {
+    struct Cell*** page = &sheet->records[idx >> RECORD_PAGE_SHIFT];
+    if (!*page) {
+        *page = calloc(RECORD_PAGE_SIZE, sizeof(struct Cell*));
+    }
+    struct Cell* cell = malloc(sizeof(struct Cell));
+    if (!*page || !cell) {
+        printf("Memory allocation failed\n");
+        exit(1);
+    }
+    cell_init(cell);
+    (*page)[idx & (RECORD_PAGE_SIZE - 1)] = cell;
+    return cell;
+}
+
+// Record of idx for writing, allocated on first use
+struct Cell* cell_at(struct Sheet* sheet, int idx) {
+    struct Cell* cell = cell_peek(sheet, idx);
+    return cell != &sheet->blank ? cell : cell_create(sheet, idx);
+}
+
+// Puts idx in or out of the topological order, in its record and tile bitmap
+void set_cell_ranked(struct Sheet* sheet, int idx, int ranked) {
+    int row, col;
+    cell_coords(sheet, idx, &row, &col);
+    Tile* tile = tile_peek(sheet, row, col);
+    unsigned long long bit = 1ULL << (col & TILE_MASK);
+    if (ranked) {
+        if (tile == &sheet->empty) tile = tile_at(sheet, row, col);
+        tile->ranked[row & TILE_MASK] |= bit;
+    } else if (tile != &sheet->empty) {
+        tile->ranked[row & TILE_MASK] &= ~bit;
+    }
+    cell_at(sheet, idx)->ranked = ranked;
+}
+
+// floor(sqrt(x)), one result bit at a time
+unsigned long long isqrt(unsigned long long x) {
+    unsigned long long root = 0;
+    unsigned long long bit = 1ULL << 62;
+    while (bit > x) bit >>= 2;
+    while (bit) {
+        if (x >= root + bit) {
+            x -= root + bit;
+            root = (root >> 1) + bit;
+        } else {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+    return root;
+}
+
+// Truncated sample standard deviation from exact count, sum and squares
+int stdev_from_moments(long long count, long long sum, __int128 squares) {
+    if (count <= 1) return 0;
+    __int128 spread = (__int128)count * squares - (__int128)sum * sum;
+    __int128 variance = spread / ((__int128)count * (count - 1));
+    return (int)isqrt((unsigned long long)variance);
+}
+
+unsigned int cellset_slot(CellSet* set, int idx) {
+    return ((unsigned int)idx * 2654435761u) & (set->capacity - 1);
+}
+
+int cellset_contains(CellSet* set, int idx) {
+    if (set->capacity == 0) return 0;
+    unsigned int slot = cellset_slot(set, idx);
+    while (set->slots[slot] != CELLSET_EMPTY) {
+        if (set->slots[slot] == idx) return 1;
+        slot = (slot + 1) & (set->capacity - 1);
+    }
+    return 0;
+}
+
+// Rebuilds the table sized for the live entries, dropping tombstones
+int cellset_rehash(CellSet* set, int min_count) {
+    int capacity = CELLSET_MIN_CAPACITY;
+    while (capacity < min_count * 2) {
+        capacity *= 2;
+    }
+    int* slots = malloc(capacity * sizeof(int));
+    if (!slots) return 1;
+    for (int i = 0; i < capacity; i++) {
+        slots[i] = CELLSET_EMPTY;
+    }
+    
+    int* old_slots = set->slots;
+    int old_capacity = set->capacity;
+    set->slots = slots;
+    set->capacity = capacity;
+    set->used = set->count;
+    for (int i = 0; i < old_capacity; i++) {
+        if (old_slots[i] >= 0) {
+            unsigned int slot = cellset_slot(set, old_slots[i]);
+            while (set->slots[slot] != CELLSET_EMPTY) {
+                slot = (slot + 1) & (set->capacity - 1);
+            }
+            set->slots[slot] = old_slots[i];
+        }
+    }
+    free(old_slots);
+    return 0;
+}
+
+int cellset_insert(CellSet* set, int idx) {
+    if (cellset_contains(set, idx)) return 0;
+    if ((set->used + 1) * 2 > set->capacity) {
+        if (cellset_rehash(set, set->count + 1) != 0) return 1;
+    }
+    unsigned int slot = cellset_slot(set, idx);
+    while (set->slots[slot] >= 0) {
+        slot = (slot + 1) & (set->capacity - 1);
+    }
+    if (set->slots[slot] == CELLSET_EMPTY) {
+        set->used++;
+    }
+    set->slots[slot] = idx;
+    set->count++;
+    return 0;
+}
+
+void cellset_remove(CellSet* set, int idx) {
+    if (set->capacity == 0) return;
+    unsigned int slot = cellset_slot(set, idx);
+    while (set->slots[slot] != CELLSET_EMPTY) {
+        if (set->slots[slot] == idx) {
+            set->slots[slot] = CELLSET_DELETED;
+            set->count--;
+            // Shrink once mostly empty so iteration stays proportional to count
+            if (set->capacity > CELLSET_MIN_CAPACITY && set->count * 8 < set->capacity) {
+                cellset_rehash(set, set->count);
+            }
+            return;
+        }
+        slot = (slot + 1) & (set->capacity - 1);
+    }
+}
+
+void cellset_free(CellSet* set) {
+    free(set->slots);
+    set->slots = NULL;
+    set->count = 0;
+    set->used = 0;
+    set->capacity = 0;
+}
+
+void add_dependency(struct Cell* dependent, int dep_idx) {
+    cellset_insert(&dependent->depends_on, dep_idx);
+}
+void add_dependent(struct Sheet* sheet, int row, int col, int dep_idx) {
+    cellset_insert(&cell_at(sheet, row * sheet->cols + col)->dependents, dep_idx);
+    if (sheet->frozen.cells) {
+        cellset_insert(&sheet->frozen.stale, row * sheet->cols + col);
+    }
+}
+
+void csr_free(DependentsCSR* csr) {
+    free(csr->cells);
+    free(csr->offsets);
+    free(csr->targets);
+    cellset_free(&csr->stale);
+    csr->cells = NULL;
+    csr->offsets = NULL;
+    csr->targets = NULL;
+    csr->cell_count = 0;
+    csr->edge_count = 0;
+}
+
+// Rebuilds the packed dependents from the live sets of recorded cells
+int csr_compact(struct Sheet* sheet) {
+    int cell_count = 0;
+    int edge_count = 0;
+    for (int p = 0; p < sheet->record_pages; p++) {
+        for (int k = 0; sheet->records[p] && k < RECORD_PAGE_SIZE; k++) {
+            struct Cell* cell = sheet->records[p][k];
+            if (cell && cell->dependents.count > 0) {
+                cell_count++;
+                edge_count += cell->dependents.count;
+            }
+        }
+    }
+    int* cells = malloc((cell_count ? cell_count : 1) * sizeof(int));
+    int* offsets = malloc((cell_count + 1) * sizeof(int));
+    int* targets = malloc((edge_count ? edge_count : 1) * sizeof(int));
+    if (!cells || !offsets || !targets) {
+        free(cells);
+        free(offsets);
+        free(targets);
+        return 1;
+    }
+    
+    int row = 0;
+    int n = 0;
+    for (int p = 0; p < sheet->record_pages; p++) {
+        for (int k = 0; sheet->records[p] && k < RECORD_PAGE_SIZE; k++) {
+            struct Cell* cell = sheet->records[p][k];
+            if (!cell || cell->dependents.count == 0) continue;
+            CellSet* dependents = &cell->dependents;
+            cells[row] = (p << RECORD_PAGE_SHIFT) + k;
+            offsets[row] = n;
+            cell->csr_row = row++;
+            for (int i = 0; i < dependents->capacity; i++) {
+                if (dependents->slots[i] >= 0) {
+                    targets[n++] = dependents->slots[i];
+                }
+            }
+        }
+    }
+    offsets[cell_count] = n;
+    
+    csr_free(&sheet->frozen);
+    sheet->frozen.cells = cells;
+    sheet->frozen.offsets = offsets;
+    sheet->frozen.targets = targets;
+    sheet->frozen.cell_count = cell_count;
+    sheet->frozen.edge_count = edge_count;
+    return 0;
+}
+
+// Slots holding the point dependents of idx; callers skip negative ones
+int* dependent_slots(struct Sheet* sheet, int idx, int* count) {
+    DependentsCSR* csr = &sheet->frozen;
+    struct Cell* cell = cell_peek(sheet, idx);
+    if (csr->cells && (csr->stale.count == 0 || !cellset_contains(&csr->stale, idx))) {
+        // A row left over from an earlier packing no longer points back here
+        int row = cell->csr_row;
+        if (row < 0 || row >= csr->cell_count || csr->cells[row] != idx) {
+            *count = 0;
+            return csr->targets;
+        }
+        *count = csr->offsets[row + 1] - csr->offsets[row];
+        return csr->targets + csr->offsets[row];
+    }
+    CellSet* dependents = &cell->dependents;
+    *count = dependents->capacity;
+    return dependents->slots;
+}
+void range_bounds(RangeDependency* range, int* bounds) {
+    bounds[0] = range->start_row;
+    bounds[1] = range->start_col;
+    bounds[2] = range->end_row;
+    bounds[3] = range->end_col;
+}
+
+long long bounds_area(int* bounds) {
+    return (long long)(bounds[2] - bounds[0] + 1) * (bounds[3] - bounds[1] + 1);
+}
+
+void bounds_union(int* into, int* other) {
+    if (other[0] < into[0]) into[0] = other[0];
+    if (other[1] < into[1]) into[1] = other[1];
+    if (other[2] > into[2]) into[2] = other[2];
+    if (other[3] > into[3]) into[3] = other[3];
+}
+
+long long bounds_enlargement(int* bounds, int* other) {
+    int merged[4] = {bounds[0], bounds[1], bounds[2], bounds[3]};
+    bounds_union(merged, other);
+    return bounds_area(merged) - bounds_area(bounds);
+}
+
+void rtree_node_bounds(RTreeNode* node, int* bounds) {
+    memcpy(bounds, node->bounds[0], sizeof(node->bounds[0]));
+    for (int i = 1; i < node->count; i++) {
+        bounds_union(bounds, node->bounds[i]);
+    }
+}
+
+void rtree_node_add(RTreeNode* node, int* bounds, void* entry) {
+    memcpy(node->bounds[node->count], bounds, sizeof(node->bounds[0]));
+    node->entries[node->count] = entry;
+    node->count++;
+    if (node->is_leaf) {
+        ((RangeDependency*)entry)->leaf = node;
+    } else {
+        ((RTreeNode*)entry)->parent = node;
+    }
+}
+
+void rtree_node_remove(RTreeNode* node, int idx) {
+    node->count--;
+    memcpy(node->bounds[idx], node->bounds[node->count], sizeof(node->bounds[0]));
+    node->entries[idx] = node->entries[node->count];
+}
+
+int rtree_entry_index(RTreeNode* node, void* entry) {
+    for (int i = 0; i < node->count; i++) {
+        if (node->entries[i] == entry) return i;
+    }
+    return -1;
+}
+
+// Quadratic split of an overflowing node into itself and sibling
+void rtree_split(RTreeNode* node, RTreeNode* sibling) {
+    sibling->is_leaf = node->is_leaf;
+    
+    int total = node->count;
+    int bounds[RTREE_MAX_ENTRIES + 1][4];
+    void* entries[RTREE_MAX_ENTRIES + 1];
+    memcpy(bounds, node->bounds, sizeof(bounds));
+    memcpy(entries, node->entries, sizeof(entries));
+    
+    int seed_a = 0, seed_b = 1;
+    long long worst = -1;
+    for (int i = 0; i < total; i++) {
+        for (int j = i + 1; j < total; j++) {
+            int merged[4] = {bounds[i][0], bounds[i][1], bounds[i][2], bounds[i][3]};
+            bounds_union(merged, bounds[j]);
+            long long waste = bounds_area(merged) - bounds_area(bounds[i]) - bounds_area(bounds[j]);
+            if (waste > worst) {
+                worst = waste;
+                seed_a = i;
+                seed_b = j;
+            }
+        }
+    }
+    
+    node->count = 0;
+    rtree_node_add(node, bounds[seed_a], entries[seed_a]);
+    rtree_node_add(sibling, bounds[seed_b], entries[seed_b]);
+    int box_a[4], box_b[4];
+    memcpy(box_a, bounds[seed_a], sizeof(box_a));
+    memcpy(box_b, bounds[seed_b], sizeof(box_b));
+    
+    int remaining = total - 2;
+    for (int i = 0; i < total; i++) {
+        if (i == seed_a || i == seed_b) continue;
+        RTreeNode* target;
+        if (node->count + remaining == RTREE_MIN_ENTRIES) {
+            target = node;
+        } else if (sibling->count + remaining == RTREE_MIN_ENTRIES) {
+            target = sibling;
+        } else {
+            long long grow_a = bounds_enlargement(box_a, bounds[i]);
+            long long grow_b = bounds_enlargement(box_b, bounds[i]);
+            if (grow_a != grow_b) {
+                target = grow_a < grow_b ? node : sibling;
+            } else {
+                target = node->count <= sibling->count ? node : sibling;
+            }
+        }
+        rtree_node_add(target, bounds[i], entries[i]);
+        bounds_union(target == node ? box_a : box_b, bounds[i]);
+        remaining--;
+    }
+}
+
+// Refreshes bounds from node to the root, splitting overflowing nodes
+void rtree_adjust(struct Sheet* sheet, RTreeNode* node, RTreeNode** spares) {
+    while (node) {
+        RTreeNode* sibling = NULL;
+        if (node->count > RTREE_MAX_ENTRIES) {
+            sibling = *spares++;
+            rtree_split(node, sibling);
+        }
+        RTreeNode* parent = node->parent;
+        int bounds[4];
+        if (!parent) {
+            if (sibling) {
+                RTreeNode* root = *spares++;
+                rtree_node_bounds(node, bounds);
+                rtree_node_add(root, bounds, node);
+                rtree_node_bounds(sibling, bounds);
+                rtree_node_add(root, bounds, sibling);
+                root->parent = NULL;
+                sheet->range_index = root;
+            }
+            return;
+        }
+        rtree_node_bounds(node, parent->bounds[rtree_entry_index(parent, node)]);
+        if (sibling) {
+            rtree_node_bounds(sibling, bounds);
+            rtree_node_add(parent, bounds, sibling);
+        }
+        node = parent;
+    }
+}
+
+// Returns 1, leaving the tree as it was, when out of memory
+int rtree_insert(struct Sheet* sheet, RangeDependency* range) {
+    int bounds[4];
+    range_bounds(range, bounds);
+    
+    if (!sheet->range_index) {
+        sheet->range_index = calloc(1, sizeof(RTreeNode));
+        if (!sheet->range_index) return 1;
+        sheet->range_index->is_leaf = 1;
+    }
+    
+    RTreeNode* node = sheet->range_index;
+    while (!node->is_leaf) {
+        int best = 0;
+        long long best_growth = -1, best_area = 0;
+        for (int i = 0; i < node->count; i++) {
+            long long growth = bounds_enlargement(node->bounds[i], bounds);
+            long long area = bounds_area(node->bounds[i]);
+            if (best_growth < 0 || growth < best_growth ||
+                (growth == best_growth && area < best_area)) {
+                best = i;
+                best_growth = growth;
+                best_area = area;
+            }
+        }
+        node = node->entries[best];
+    }
+    
+    // Allocate every node the splits may need before changing the tree
+    RTreeNode* spares[RTREE_MAX_HEIGHT + 1];
+    int needed = 0;
+    for (RTreeNode* full = node; full && full->count == RTREE_MAX_ENTRIES; full = full->parent) {
+        needed += full->parent ? 1 : 2;
+    }
+    for (int i = 0; i < needed; i++) {
+        spares[i] = calloc(1, sizeof(RTreeNode));
+        if (!spares[i]) {
+            while (i-- > 0) free(spares[i]);
+            return 1;
+        }
+    }
+    rtree_node_add(node, bounds, range);
+    rtree_adjust(sheet, node, spares);
+    return 0;
+}
+
+void range_list_push(RangeList* list, RangeDependency* range) {
+    if (list->count == list->capacity) {
+        int capacity = list->capacity ? list->capacity * 2 : 16;
+        RangeDependency** items = realloc(list->items, capacity * sizeof(RangeDependency*));
+        if (!items) return;
+        list->items = items;
+        list->capacity = capacity;
+    }
+    list->items[list->count++] = range;
+}
+
+int worklist_push(Worklist* list, int item) {
+    if (list->count == list->capacity) {
+        int capacity = list->capacity ? list->capacity * 2 : 64;
+        int* items = realloc(list->items, capacity * sizeof(int));
+        if (!items) return 1;
+        list->items = items;
+        list->capacity = capacity;
+    }
+    list->items[list->count++] = item;
+    return 0;
+}
+
+// Grows list to hold at least capacity items; returns 1 when out of memory
+int worklist_reserve(Worklist* list, int capacity) {
+    if (list->capacity >= capacity) return 0;
+    int* items = realloc(list->items, capacity * sizeof(int));
+    if (!items) return 1;
+    list->items = items;
+    list->capacity = capacity;
+    return 0;
+}
+
+// Collects every range edge stored under node and frees the nodes themselves
+void rtree_release(RTreeNode* node, RangeList* orphans) {
+    RTreeNode* stack[RTREE_STACK_SIZE];
+    int top = 0;
+    stack[top++] = node;
+    while (top > 0) {
+        RTreeNode* curr = stack[--top];
+        for (int i = 0; i < curr->count; i++) {
+            if (curr->is_leaf) {
+                range_list_push(orphans, curr->entries[i]);
+            } else {
+                stack[top++] = curr->entries[i];
+            }
+        }
+        free(curr);
+    }
+}
+
+void rtree_remove(struct Sheet* sheet, RangeDependency* range) {
+    RTreeNode* node = range->leaf;
+    if (!node) return;
+    rtree_node_remove(node, rtree_entry_index(node, range));
+    range->leaf = NULL;
+    
+    // Condense: underfull nodes are dissolved and their edges reinserted
+    RangeList orphans = {NULL, 0, 0};
+    while (node->parent) {
+        RTreeNode* parent = node->parent;
+        int idx = rtree_entry_index(parent, node);
+        if (node->count < RTREE_MIN_ENTRIES) {
+            rtree_node_remove(parent, idx);
+            rtree_release(node, &orphans);
+        } else {
+            rtree_node_bounds(node, parent->bounds[idx]);
+        }
+        node = parent;
+    }
+    
+    while (!node->is_leaf && node->count == 1) {
+        RTreeNode* child = node->entries[0];
+        child->parent = NULL;
+        free(node);
+        node = child;
+    }
+    if (node->count == 0) {
+        free(node);
+        node = NULL;
+    }
+    sheet->range_index = node;
+    
+    for (int i = 0; i < orphans.count; i++) {
+        if (rtree_insert(sheet, orphans.items[i]) != 0) {
+            printf("Memory allocation failed\n");
+            exit(1);
+        }
+    }
+    free(orphans.items);
+}
+
+// Fills hits with every range edge whose rectangle covers (row, col)
+void find_range_dependents(struct Sheet* sheet, int row, int col, RangeList* hits) {
+    hits->count = 0;
+    if (!sheet->range_index) return;
+    
+    RTreeNode* stack[RTREE_STACK_SIZE];
+    int top = 0;
+    stack[top++] = sheet->range_index;
+    while (top > 0) {
+        RTreeNode* node = stack[--top];
+        for (int i = 0; i < node->count; i++) {
+            int* b = node->bounds[i];
+            if (row < b[0] || row > b[2] || col < b[1] || col > b[3]) continue;
+            if (node->is_leaf) {
+                range_list_push(hits, node->entries[i]);
+            } else {
+                stack[top++] = node->entries[i];
+            }
+        }
+    }
+}
+
+void column_index_free(struct Sheet* sheet, int col) {
+    ColumnIndex* index = sheet->columns[col];
+    if (!index) return;
+    free(index->sums);
+    free(index->squares);
+    free(index->errors);
+    free(index->lows);
+    free(index->highs);
+    free(index->held);
+    free(index->queued);
+    free(index->pending.items);
+    free(index);
+    sheet->columns[col] = NULL;
+}
+
+int column_min(int a, int b) { return a < b ? a : b; }
+int column_max(int a, int b) { return a > b ? a : b; }
+
+// Adds rows [start_row, end_row] of the column to *block, *low and *high
+void column_scan(struct Sheet* sheet, int col, int start_row, int end_row,
+                 ColumnBlock* block, int* low, int* high) {
+    int bit = col & TILE_MASK;
+    while (start_row <= end_row) {
+        int last_row = column_min(end_row, start_row | TILE_MASK);
+        Tile* tile = tile_peek(sheet, start_row, col);
+        if (tile == &sheet->empty) {
+            *low = column_min(*low, 0);
+            *high = column_max(*high, 0);
+        } else {
+            const int* values = &tile->values[tile_offset(start_row, col)];
+            for (int r = start_row; r <= last_row; r++, values += TILE_SIZE) {
+                int value = *values;
+                block->total += value;
+                block->squares += (long long)value * value;
+                block->errors += (tile->errors[r & TILE_MASK] >> bit) & 1;
+                *low = column_min(*low, value);
+                *high = column_max(*high, value);
+            }
+        }
+        start_row = last_row + 1;
+    }
+}
+
+// Rescans block b of the column into the trees
+void column_block_update(struct Sheet* sheet, int col, int b) {
+    ColumnIndex* index = sheet->columns[col];
+    int first_row = b << TILE_SHIFT;
+    int last_row = column_min(first_row + TILE_MASK, sheet->rows - 1);
+    ColumnBlock block = {0, 0, 0};
+    int low = value_at(sheet, first_row, col);
+    int high = low;
+    column_scan(sheet, col, first_row, last_row, &block, &low, &high);
+    
+    long long delta = block.total - index->held[b].total;
+    __int128 square_delta = block.squares - index->held[b].squares;
+    int error_delta = block.errors - index->held[b].errors;
+    index->held[b] = block;
+    if (delta != 0 || square_delta != 0 || error_delta != 0) {
+        for (int i = b + 1; i <= index->blocks; i += i & -i) {
+            index->sums[i] += delta;
+            index->squares[i] += square_delta;
+            index->errors[i] += error_delta;
+        }
+    }
+    int i = index->blocks + b;
+    if (index->lows[i] == low && index->highs[i] == high) return;
+    index->lows[i] = low;
+    index->highs[i] = high;
+    for (i >>= 1; i >= 1; i >>= 1) {
+        index->lows[i] = column_min(index->lows[2 * i], index->lows[2 * i + 1]);
+        index->highs[i] = column_max(index->highs[2 * i], index->highs[2 * i + 1]);
+    }
+}
+
+// Allocates the trees of an empty column index, 1 when out of memory
+int column_index_fill(struct Sheet* sheet, int col) {
+    ColumnIndex* index = sheet->columns[col];
+    int n = sheet->tile_rows;
+    index->sums = calloc(n + 1, sizeof(long long));
+    index->squares = calloc(n + 1, sizeof(__int128));
+    index->errors = calloc(n + 1, sizeof(int));
+    index->lows = calloc(2 * n, sizeof(int));
+    index->highs = calloc(2 * n, sizeof(int));
+    index->held = calloc(n, sizeof(ColumnBlock));
+    index->queued = calloc(n, 1);
+    if (!index->sums || !index->squares || !index->errors || !index->lows || !index->highs ||
+        !index->held || !index->queued) {
+        return 1;
+    }
+    
+    // Only blocks with a tile need a rescan
+    index->blocks = n;
+    for (int b = 0; b < n; b++) {
+        if (sheet->tiles[b * sheet->tile_cols + (col >> TILE_SHIFT)]) {
+            column_block_update(sheet, col, b);
+        }
+    }
+    return 0;
+}
+
+void column_index_build(struct Sheet* sheet, int col) {
+    ColumnIndex* index = calloc(1, sizeof(ColumnIndex));
+    if (!index) return;
+    sheet->columns[col] = index;
+    
+    // An all-zero column gets its trees on the first write
+    for (int b = 0; b < sheet->tile_rows; b++) {
+        if (sheet->tiles[b * sheet->tile_cols + (col >> TILE_SHIFT)]) {
+            if (column_index_fill(sheet, col) != 0) {
+                column_index_free(sheet, col);
+            }
+            return;
+        }
+    }
+}
+
+// Notes that (row, col) may have a new value or error state
+void column_touch(struct Sheet* sheet, int row, int col) {
+    ColumnIndex* index = sheet->columns[col];
+    if (!index) return;
+    if (!index->blocks) {
+        if (value_at(sheet, row, col) == 0 && !error_at(sheet, row, col)) return;
+        if (column_index_fill(sheet, col) != 0) {
+            column_index_free(sheet, col);
+        }
+        return;
+    }
+    int b = row >> TILE_SHIFT;
+    if (!index->queued[b]) {
+        index->queued[b] = 1;
+        worklist_push(&index->pending, b);
+    }
+}
+
+// Folds the queued blocks into the trees
+void column_index_sync(struct Sheet* sheet, int col) {
+    ColumnIndex* index = sheet->columns[col];
+    for (int k = 0; k < index->pending.count; k++) {
+        int b = index->pending.items[k];
+        index->queued[b] = 0;
+        column_block_update(sheet, col, b);
+    }
+    index->pending.count = 0;
+}
+
+// Totals rows [start_row, end_row] of an indexed column
+void column_index_query(struct Sheet* sheet, int col, int start_row, int end_row,
+                        long long* total, __int128* squares, int* errors) {
+    ColumnIndex* index = sheet->columns[col];
+    if (!index->blocks) return;
+    if (index->pending.count > 0) {
+        column_index_sync(sheet, col);
+    }
+    
+    // Whole blocks [first, last] from the trees, the ends from the tiles
+    int first = (start_row + TILE_MASK) >> TILE_SHIFT;
+    int last = ((end_row + 1) >> TILE_SHIFT) - 1;
+    ColumnBlock ends = {0, 0, 0};
+    int low = 0, high = 0;
+    if (first > last) {
+        column_scan(sheet, col, start_row, end_row, &ends, &low, &high);
+    } else {
+        column_scan(sheet, col, start_row, (first << TILE_SHIFT) - 1, &ends, &low, &high);
+        column_scan(sheet, col, (last + 1) << TILE_SHIFT, end_row, &ends, &low, &high);
+        for (int i = last + 1; i > 0; i -= i & -i) {
+            ends.total += index->sums[i];
+            ends.squares += index->squares[i];
+            ends.errors += index->errors[i];
+        }
+        for (int i = first; i > 0; i -= i & -i) {
+            ends.total -= index->sums[i];
+            ends.squares -= index->squares[i];
+            ends.errors -= index->errors[i];
+        }
+    }
+    *total += ends.total;
+    *squares += ends.squares;
+    *errors += ends.errors;
+}
+
+// MIN (opcode 1) or MAX (opcode 2) of rows [start_row, end_row] of an indexed column
+int column_index_extreme(struct Sheet* sheet, int col, int start_row, int end_row, int opcode) {
+    ColumnIndex* index = sheet->columns[col];
+    if (!index->blocks) return 0;
+    if (index->pending.count > 0) {
+        column_index_sync(sheet, col);
+    }
+    
+    int first = (start_row + TILE_MASK) >> TILE_SHIFT;
+    int last = ((end_row + 1) >> TILE_SHIFT) - 1;
+    ColumnBlock ends = {0, 0, 0};
+    int low = value_at(sheet, start_row, col);
+    int high = low;
+    if (first > last) {
+        column_scan(sheet, col, start_row, end_row, &ends, &low, &high);
+        return opcode == 1 ? low : high;
+    }
+    column_scan(sheet, col, start_row, (first << TILE_SHIFT) - 1, &ends, &low, &high);
+    column_scan(sheet, col, (last + 1) << TILE_SHIFT, end_row, &ends, &low, &high);
+    int* nodes = opcode == 1 ? index->lows : index->highs;
+    int result = opcode == 1 ? low : high;
+    for (int l = first + index->blocks, r = last + index->blocks + 1; l < r; l >>= 1, r >>= 1) {
+        if (l & 1) {
+            result = opcode == 1 ? column_min(result, nodes[l]) : column_max(result, nodes[l]);
+            l++;
+        }
+        if (r & 1) {
+            r--;
+            result = opcode == 1 ? column_min(result, nodes[r]) : column_max(result, nodes[r]);
+        }
+    }
+    return result;
+}
+
+unsigned int aggregate_hash(int* bounds) {
+    unsigned int hash = 2166136261u;
+    for (int i = 0; i < 4; i++) {
+        hash = (hash ^ (unsigned int)bounds[i]) * 16777619u;
+    }
+    return hash;
+}
+
+int aggregate_rehash(AggregateTable* table, int capacity) {
+    RangeAggregate** buckets = calloc(capacity, sizeof(RangeAggregate*));
+    if (!buckets) return 1;
+    for (int i = 0; i < table->capacity; i++) {
+        RangeAggregate* aggregate = table->buckets[i];
+        while (aggregate) {
+            RangeAggregate* next = aggregate->next;
+            unsigned int slot = aggregate_hash(aggregate->bounds) & (capacity - 1);
+            aggregate->next = buckets[slot];
+            buckets[slot] = aggregate;
+            aggregate = next;
+        }
+    }
+    free(table->buckets);
+    table->buckets = buckets;
+    table->capacity = capacity;
+    return 0;
+}
+
+// Referenced shared state of the rectangle, NULL when out of memory
+RangeAggregate* aggregate_acquire(AggregateTable* table, int* bounds) {
+    if (table->capacity > 0) {
+        unsigned int slot = aggregate_hash(bounds) & (table->capacity - 1);
+        for (RangeAggregate* aggregate = table->buckets[slot]; aggregate; aggregate = aggregate->next) {
+            if (memcmp(aggregate->bounds, bounds, sizeof(aggregate->bounds)) == 0) {
+                aggregate->refs++;
+                return aggregate;
+            }
+        }
+    }
+    
+    if ((table->count + 1) * 2 > table->capacity) {
+        if (aggregate_rehash(table, table->capacity ? table->capacity * 2 : 64) != 0) return NULL;
+    }
+    RangeAggregate* aggregate = calloc(1, sizeof(RangeAggregate));
+    if (!aggregate) return NULL;
+    memcpy(aggregate->bounds, bounds, sizeof(aggregate->bounds));
+    aggregate->refs = 1;
+    unsigned int slot = aggregate_hash(bounds) & (table->capacity - 1);
+    aggregate->next = table->buckets[slot];
+    table->buckets[slot] = aggregate;
+    table->count++;
+    return aggregate;
+}
+
+void aggregate_release(AggregateTable* table, RangeAggregate* aggregate) {
+    if (--aggregate->refs > 0) return;
+    unsigned int slot = aggregate_hash(aggregate->bounds) & (table->capacity - 1);
+    RangeAggregate** link = &table->buckets[slot];
+    while (*link != aggregate) {
+        link = &(*link)->next;
+    }
+    *link = aggregate->next;
+    table->count--;
+    free(aggregate);
+}
+
+// Next Kahn-step stamp, clearing every old one when the counter wraps
+unsigned int next_aggregate_stamp(struct Sheet* sheet) {
+    if (++sheet->aggregate_stamp == 0) {
+        AggregateTable* table = &sheet->aggregates;
+        for (int i = 0; i < table->capacity; i++) {
+            for (RangeAggregate* aggregate = table->buckets[i]; aggregate; aggregate = aggregate->next) {
+                aggregate->stamp = 0;
+            }
+        }
+        sheet->aggregate_stamp = 1;
+    }
+    return sheet->aggregate_stamp;
+}
+
+void aggregate_table_free(AggregateTable* table) {
+    for (int i = 0; i < table->capacity; i++) {
+        RangeAggregate* aggregate = table->buckets[i];
+        while (aggregate) {
+            RangeAggregate* next = aggregate->next;
+            free(aggregate);
+            aggregate = next;
+        }
+    }
+    free(table->buckets);
+}
+
+// Returns 1 when out of memory, with no edge added
+int add_range_dependency(struct Sheet* sheet, int row, int col, int start_row, int start_col, int end_row, int end_col) {
+    RangeDependency* range = malloc(sizeof(RangeDependency));
+    if (!range) return 1;
+    
+    range->row = row;
+    range->col = col;
+    range->start_row = start_row;
+    range->start_col = start_col;
+    range->end_row = end_row;
+    range->end_col = end_col;
+    range->leaf = NULL;
+    range->aggregate = NULL;
+    
+    // SUM, AVG and STDEV share one state per rectangle
+    struct Cell* cell = cell_at(sheet, row * sheet->cols + col);
+    int opcode = cell->formula >= 0 ? sheet->formulas.items[cell->formula].opcode : 0;
+    int area = (end_row - start_row + 1) * (end_col - start_col + 1);
+    int bounds[4] = {start_row, start_col, end_row, end_col};
+    if (opcode >= 3 && opcode <= 5) {
+        range->aggregate = aggregate_acquire(&sheet->aggregates, bounds);
+    }
+    int extreme = (opcode == 1 || opcode == 2) && area >= RANGE_TREE_MIN_CELLS;
+    if (rtree_insert(sheet, range) != 0) {
+        if (range->aggregate) {
+            aggregate_release(&sheet->aggregates, range->aggregate);
+        }
+        free(range);
+        return 1;
+    }
+    cell_at(sheet, row * sheet->cols + col)->depends_on_range = range;
+    
+    // Formulas over a rectangle that already has a state add no new query
+    if (range->aggregate && range->aggregate->refs > 1) return 0;
+    for (int c = start_col; c <= end_col; c++) {
+        if ((++sheet->column_ranges[c] > COLUMN_INDEX_MIN_RANGES || extreme) && !sheet->columns[c]) {
+            column_index_build(sheet, c);
+        }
+    }
+    return 0;
+}
+// Drops every edge into (row, col), point and range, from both ends
+void clear_dependencies(struct Sheet* sheet, int row, int col) {
+    struct Cell* cell = cell_at(sheet, row * sheet->cols + col);
+    int cell_idx = row * sheet->cols + col;
+    for (int i = 0; i < cell->depends_on.capacity; i++) {
+        int idx = cell->depends_on.slots[i];
+        if (idx >= 0) {
+            cellset_remove(&cell_at(sheet, idx)->dependents, cell_idx);
+            if (sheet->frozen.cells) {
+                cellset_insert(&sheet->frozen.stale, idx);
+            }
+        }
+    }
+    cellset_free(&cell->depends_on);
+    set_cell_ranked(sheet, cell_idx, 0);
+    if (cell->cyclic) {
+        cell->cyclic = 0;
+        cellset_remove(&sheet->cyclic_cells, cell_idx);
+    }
+    
+    RangeDependency* range = cell->depends_on_range;
+    if (range) {
+        // Only the last formula over a state takes its query away
+        if (!range->aggregate || range->aggregate->refs == 1) {
+            for (int c = range->start_col; c <= range->end_col; c++) {
+                if (--sheet->column_ranges[c] == 0) {
+                    column_index_free(sheet, c);
+                }
+            }
+        }
+        if (range->aggregate) {
+            aggregate_release(&sheet->aggregates, range->aggregate);
+        }
+        rtree_remove(sheet, range);
+        free(range);
+        cell->depends_on_range = NULL;
+    }
+}
+
+//Below fumctiom prints dependencies and was used for debugging
+void print_dependencies(struct Sheet* sheet) {
+    printf("\n--- Current Dependencies ---\n");
+    for (int i = 0; i < sheet->rows; i++) {
+        for (int j = 0; j < sheet->cols; j++) {
+            char cell_name[10];
+            get_column_name(j + 1, cell_name);
+            printf("%s%d: ", cell_name, i + 1);
+            
+            // Print dependencies
+            printf("depends on: ");
+            CellSet* set = &cell_peek(sheet, i * sheet->cols + j)->depends_on;
+            if (set->count == 0 && !cell_peek(sheet, i * sheet->cols + j)->depends_on_range) {
+                printf("none");
+            }
+            for (int k = 0; k < set->capacity; k++) {
+                if (set->slots[k] < 0) continue;
+                char dep_name[10];
+                get_column_name(set->slots[k] % sheet->cols + 1, dep_name);
+                printf("%s%d ", dep_name, set->slots[k] / sheet->cols + 1);
+            }
+            RangeDependency* range = cell_peek(sheet, i * sheet->cols + j)->depends_on_range;
+            if (range) {
+                char start_name[10], end_name[10];
+                get_column_name(range->start_col + 1, start_name);
+                get_column_name(range->end_col + 1, end_name);
+                printf("%s%d:%s%d ", start_name, range->start_row + 1, end_name, range->end_row + 1);
+            }
+            
+            // Print dependents
+            printf(", dependents: ");
+            set = &cell_peek(sheet, i * sheet->cols + j)->dependents;
+            for (int k = 0; k < set->capacity; k++) {
+                if (set->slots[k] < 0) continue;
+                char dep_name[10];
+                get_column_name(set->slots[k] % sheet->cols + 1, dep_name);
+                printf("%s%d ", dep_name, set->slots[k] / sheet->cols + 1);
+            }
+            find_range_dependents(sheet, i, j, &sheet->range_hits);
+            for (int k = 0; k < sheet->range_hits.count; k++) {
+                char dep_name[10];
+                get_column_name(sheet->range_hits.items[k]->col + 1, dep_name);
+                printf("%s%d ", dep_name, sheet->range_hits.items[k]->row + 1);
+            }
+            printf("\n");
+        }
+    }
+    printf("-------------------------\n\n");
+}
+int setarith(struct Sheet* sheet, int idx, int val1, int val2, int opcode) {
+    int result;
+    set_cell_error(sheet, idx, 0); // Reset error flag
+    
+    switch(opcode) {
+        case 1:  // Addition
+            result = val1 + val2;
+            break;
+        case 2:  // Subtraction
+            result = val1 - val2;
+            break;
+        case 3:  // Multiplication
+            result = val1 * val2;
+            break;
+        case 4:  // Division
+            if(val2 == 0) {
+                set_cell_error(sheet, idx, 1);
+                return 1; 
+            }
+            result = val1 / val2;
+            break;
+        default:
+            set_cell_error(sheet, idx, 1);
+            return 1;  
+    }
+    
+    set_cell_value(sheet, idx, result);
+    return 0;
+}
+
+// The JIT compiles REF and +, -, * formulas with their cell addresses baked in
+unsigned char* jit_code(JitArena* jit, int slot) {
+    return jit->chunks[slot / JIT_CHUNK_SLOTS] + (slot % JIT_CHUNK_SLOTS) * JIT_SLOT_SIZE;
+}
+
+void jit_release(JitArena* jit, struct Cell* cell) {
+    if (cell->jit_slot < 0) return;
+    if (jit->free_count == jit->free_capacity) {
+        int capacity = jit->free_capacity ? jit->free_capacity * 2 : 64;
+        int* slots = realloc(jit->free_slots, capacity * sizeof(int));
+        if (!slots) {
+            cell->jit_slot = -1;  // leaked until the arena is freed
+            return;
+        }
+        jit->free_slots = slots;
+        jit->free_capacity = capacity;
+    }
+    jit->free_slots[jit->free_count++] = cell->jit_slot;
+    cell->jit_slot = -1;
+}
+
+int jit_alloc_slot(JitArena* jit) {
+    if (jit->free_count > 0) return jit->free_slots[--jit->free_count];
+    if (jit->next_slot == jit->chunk_count * JIT_CHUNK_SLOTS) {
+        unsigned char** chunks = realloc(jit->chunks, (jit->chunk_count + 1) * sizeof(unsigned char*));
+        if (!chunks) return -1;
+        jit->chunks = chunks;
+        unsigned char* writable = realloc(jit->writable, jit->chunk_count + 1);
+        if (!writable) return -1;
+        jit->writable = writable;
+        jit->writable[jit->chunk_count] = 0;
+        void* code = mmap(NULL, JIT_SLOT_SIZE * JIT_CHUNK_SLOTS, PROT_READ | PROT_EXEC,
+                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (code == MAP_FAILED) return -1;
+        jit->chunks[jit->chunk_count++] = code;
+    }
+    return jit->next_slot++;
+}
+
+void jit_free(JitArena* jit) {
+    for (int i = 0; i < jit->chunk_count; i++) {
+        munmap(jit->chunks[i], JIT_SLOT_SIZE * JIT_CHUNK_SLOTS);
+    }
+    free(jit->chunks);
+    free(jit->writable);
+    free(jit->free_slots);
+    jit->pending.count = 0;
+    jit->chunks = NULL;
+    jit->writable = NULL;
+    jit->chunk_count = 0;
+    jit->next_slot = 0;
+    jit->free_slots = NULL;
+    jit->free_count = 0;
+    jit->free_capacity = 0;
+}
+
+#if defined(__x86_64__)
+typedef struct JitBuffer {
+    unsigned char bytes[JIT_SLOT_SIZE];
+    int length;
+} JitBuffer;
+
+void jit_emit(JitBuffer* buf, const char* bytes, int count) {
+    memcpy(buf->bytes + buf->length, bytes, count);
+    buf->length += count;
+}
+
+void jit_emit_u32(JitBuffer* buf, unsigned int x) {
+    memcpy(buf->bytes + buf->length, &x, 4);
+    buf->length += 4;
+}
+
+// movabs rax, address
+void jit_emit_address(JitBuffer* buf, void* address) {
+    unsigned long long x = (unsigned long long)address;
+    jit_emit(buf, "\x48\xb8", 2);
+    memcpy(buf->bytes + buf->length, &x, 8);
+    buf->length += 8;
+}
+
+// Loads an operand into ecx (reg 0) or edx (reg 1), jumping out on an error
+void jit_emit_operand(JitBuffer* buf, struct Sheet* sheet, int row, int col, Operand* operand, int reg,
+                      int* patches, int* patch_count) {
+    if (!operand->is_cell) {
+        jit_emit(buf, reg ? "\xba" : "\xb9", 1);                  // mov r32, imm32
+        jit_emit_u32(buf, (unsigned int)operand->value);
+        return;
+    }
+    int source_col = col + operand->col;
+    int idx = (row + operand->row) * sheet->cols + source_col;
+    int bit = source_col & TILE_MASK;
+    char mask = (char)(1u << (bit & 7));
+    jit_emit_address(buf, (char*)error_word(sheet, idx) + (bit >> 3));
+    jit_emit(buf, "\xf6\x00", 2);                                 // test byte [rax], imm8
+    jit_emit(buf, &mask, 1);
+    jit_emit(buf, "\x0f\x85", 2);                                 // jne rel32
+    patches[(*patch_count)++] = buf->length;
+    jit_emit_u32(buf, 0);
+    jit_emit_address(buf, value_slot(sheet, idx));
+    jit_emit(buf, reg ? "\x8b\x10" : "\x8b\x08", 2);             // mov r32, [rax]
+}
+
+// Sets or clears the error bit of cell idx and returns 0
+void jit_emit_exit(JitBuffer* buf, struct Sheet* sheet, int idx, int flag) {
+    int bit = idx % sheet->cols & TILE_MASK;
+    char mask = (char)(1u << (bit & 7));
+    jit_emit_address(buf, (char*)error_word(sheet, idx) + (bit >> 3));
+    if (flag) {
+        jit_emit(buf, "\x80\x08", 2);                             // or byte [rax], imm8
+    } else {
+        mask = ~mask;
+        jit_emit(buf, "\x80\x20", 2);                             // and byte [rax], imm8
+    }
+    jit_emit(buf, &mask, 1);
+    jit_emit(buf, "\x31\xc0\xc3", 3);                             // xor eax, eax; ret
+}
+
+int jit_assemble(JitBuffer* buf, struct Sheet* sheet, int row, int col, Formula* formula) {
+    int idx = row * sheet->cols + col;
+    int patches[2];
+    int patch_count = 0;
+    
+    if (formula->kind == FORMULA_REF) {
+        jit_emit_operand(buf, sheet, row, col, &formula->left, 0, patches, &patch_count);
+    } else if (formula->kind == FORMULA_ARITH && formula->opcode >= 1 && formula->opcode <= 3) {
+        jit_emit_operand(buf, sheet, row, col, &formula->left, 0, patches, &patch_count);
+        jit_emit_operand(buf, sheet, row, col, &formula->right, 1, patches, &patch_count);
+        switch (formula->opcode) {
+            case 1: jit_emit(buf, "\x01\xd1", 2); break;              // add ecx, edx
+            case 2: jit_emit(buf, "\x29\xd1", 2); break;              // sub ecx, edx
+            case 3: jit_emit(buf, "\x0f\xaf\xca", 3); break;          // imul ecx, edx
+        }
+    } else {
+        return 1;
+    }
+    
+    jit_emit_address(buf, value_slot(sheet, idx));
+    jit_emit(buf, "\x89\x08", 2);                                 // mov [rax], ecx
+    jit_emit_exit(buf, sheet, idx, 0);
+    
+    int error_exit = buf->length;
+    jit_emit_exit(buf, sheet, idx, 1);
+    for (int i = 0; i < patch_count; i++) {
+        unsigned int rel = error_exit - (patches[i] + 4);
+        memcpy(buf->bytes + patches[i], &rel, 4);
+    }
+    return 0;
+}
+#else
+typedef struct JitBuffer {
+    int length;
+} JitBuffer;
+
+// No native code here; every formula stays on the interpreter
+int jit_assemble(JitBuffer* buf, struct Sheet* sheet, int row, int col, Formula* formula) {
+    (void)buf;
+    (void)sheet;
+    (void)row;
+    (void)col;
+    (void)formula;
+    return 1;
+}
+#endif
+
+// Compiles the pending cells whose formula has a supported shape
+void jit_flush(struct Sheet* sheet) {
+    JitArena* jit = &sheet->jit;
+    size_t chunk_size = JIT_SLOT_SIZE * JIT_CHUNK_SLOTS;
+#if defined(__x86_64__)
+    for (int i = 0; i < jit->pending.count; i++) {
+        int idx = jit->pending.items[i];
+        struct Cell* cell = cell_at(sheet, idx);
+        if (cell->jit_slot >= 0 || cell->formula < 0) continue;
+        
+        JitBuffer buf;
+        buf.length = 0;
+        Formula* formula = &sheet->formulas.items[cell->formula];
+        if (jit_assemble(&buf, sheet, idx / sheet->cols, idx % sheet->cols, formula) != 0) continue;
+        int slot = jit_alloc_slot(jit);
+        if (slot < 0) break;
+        
+        int chunk = slot / JIT_CHUNK_SLOTS;
+        cell->jit_slot = slot;
+        if (!jit->writable[chunk]) {
+            if (mprotect(jit->chunks[chunk], chunk_size, PROT_READ | PROT_WRITE) != 0) {
+                jit_release(jit, cell);
+                continue;
+            }
+            jit->writable[chunk] = 1;
+        }
+        memcpy(jit_code(jit, slot), buf.bytes, buf.length);
+    }
+#endif
+    jit->pending.count = 0;
+    
+    for (int i = 0; i < jit->chunk_count; i++) {
+        if (jit->writable[i]) {
+            mprotect(jit->chunks[i], chunk_size, PROT_READ | PROT_EXEC);
+            __builtin___clear_cache((char*)jit->chunks[i], (char*)jit->chunks[i] + chunk_size);
+            jit->writable[i] = 0;
+        }
+    }
+}
+
+// Drops the cell's native code and queues its formula for compilation
+void jit_compile(struct Sheet* sheet, struct Cell* cell, int idx) {
+    jit_release(&sheet->jit, cell);
+    if (sheet->jit.enabled) {
+        worklist_push(&sheet->jit.pending, idx);
+    }
+}
+
+// Compiles or drops native code for every formula on the sheet
+void jit_set_enabled(struct Sheet* sheet, int enabled) {
+    sheet->jit.enabled = enabled;
+    for (int p = 0; p < sheet->record_pages; p++) {
+        if (!sheet->records[p]) continue;
+        for (int k = 0; k < RECORD_PAGE_SIZE; k++) {
+            struct Cell* cell = sheet->records[p][k];
+            if (!cell) continue;
+            if (enabled && cell->formula >= 0) {
+                jit_compile(sheet, cell, (p << RECORD_PAGE_SHIFT) + k);
+            } else {
+                cell->jit_slot = -1;
+            }
+        }
+    }
+    if (enabled) {
+        jit_flush(sheet);
+    } else {
+        jit_free(&sheet->jit);
+    }
+}
+
+unsigned int formula_hash(Formula* formula) {
+    const int* words = (const int*)formula;
+    unsigned int hash = 2166136261u;
+    for (size_t i = 0; i < sizeof(Formula) / sizeof(int); i++) {
+        hash = (hash ^ (unsigned int)words[i]) * 16777619u;
+    }
+    return hash;
+}
+
+// Returns the bucket holding an equal formula, or -1
+int formula_find(FormulaTable* table, Formula* formula) {
+    if (table->bucket_capacity == 0) return -1;
+    unsigned int mask = table->bucket_capacity - 1;
+    unsigned int slot = formula_hash(formula) & mask;
+    while (table->buckets[slot] != FORMULA_EMPTY) {
+        int id = table->buckets[slot];
+        if (id >= 0 && memcmp(&table->items[id], formula, sizeof(Formula)) == 0) {
+            return slot;
+        }
+        slot = (slot + 1) & mask;
+    }
+    return -1;
+}
+
+int formula_reindex(FormulaTable* table, int bucket_capacity) {
+    int* buckets = malloc(bucket_capacity * sizeof(int));
+    if (!buckets) return 1;
+    for (int i = 0; i < bucket_capacity; i++) {
+        buckets[i] = FORMULA_EMPTY;
+    }
+    int used = 0;
+    for (int i = 0; i < table->bucket_capacity; i++) {
+        int id = table->buckets[i];
+        if (id < 0) continue;
+        unsigned int slot = formula_hash(&table->items[id]) & (bucket_capacity - 1);
+        while (buckets[slot] != FORMULA_EMPTY) {
+            slot = (slot + 1) & (bucket_capacity - 1);
+        }
+        buckets[slot] = id;
+        used++;
+    }
+    free(table->buckets);
+    table->buckets = buckets;
+    table->bucket_capacity = bucket_capacity;
+    table->bucket_used = used;
+    return 0;
+}
+
+// Id of formula, interned if new, with a reference taken; -1 when out of memory
+int formula_intern(FormulaTable* table, Formula* formula) {
+    int found = formula_find(table, formula);
+    if (found >= 0) {
+        table->refs[table->buckets[found]]++;
+        return table->buckets[found];
+    }
+    
+    if ((table->bucket_used + 1) * 4 > table->bucket_capacity * 3) {
+        int live = table->count - table->free_ids.count;
+        int bucket_capacity = 16;
+        while (bucket_capacity < (live + 1) * 2) bucket_capacity *= 2;
+        if (formula_reindex(table, bucket_capacity) != 0) return -1;
+    }
+    
+    int id;
+    if (table->free_ids.count > 0) {
+        id = table->free_ids.items[--table->free_ids.count];
+    } else {
+        if (table->count == table->capacity) {
+            int capacity = table->capacity ? table->capacity * 2 : 64;
+            Formula* items = realloc(table->items, capacity * sizeof(Formula));
+            if (!items) return -1;
+            table->items = items;
+            int* refs = realloc(table->refs, capacity * sizeof(int));
+            if (!refs) return -1;
+            table->refs = refs;
+            table->capacity = capacity;
+        }
+        id = table->count++;
+    }
+    table->items[id] = *formula;
+    table->refs[id] = 1;
+    
+    unsigned int slot = formula_hash(formula) & (table->bucket_capacity - 1);
+    while (table->buckets[slot] >= 0) {
+        slot = (slot + 1) & (table->bucket_capacity - 1);
+    }
+    if (table->buckets[slot] == FORMULA_EMPTY) table->bucket_used++;
+    table->buckets[slot] = id;
+    return id;
+}
+
+void formula_release(FormulaTable* table, int id) {
+    if (--table->refs[id] > 0) return;
+    table->buckets[formula_find(table, &table->items[id])] = FORMULA_DELETED;
+    worklist_push(&table->free_ids, id);
+}
+
+void formula_table_free(FormulaTable* table) {
+    free(table->items);
+    free(table->refs);
+    free(table->free_ids.items);
+    free(table->buckets);
+}
+
+// Gives the cell the formula built by a handler with absolute coordinates
+void set_formula(struct Sheet* sheet, int row, int col, Formula* formula) {
+    struct Cell* cell = cell_at(sheet, row * sheet->cols + col);
+    Formula relative = *formula;
+    if (relative.left.is_cell) {
+        relative.left.row -= row;
+        relative.left.col -= col;
+    }
+    if (relative.right.is_cell) {
+        relative.right.row -= row;
+        relative.right.col -= col;
+    }
+    if (relative.kind == FORMULA_FUNC) {
+        relative.start_row -= row;
+        relative.start_col -= col;
+        relative.end_row -= row;
+        relative.end_col -= col;
+    }
+    
+    int id = formula_intern(&sheet->formulas, &relative);
+    if (cell->formula >= 0) {
+        formula_release(&sheet->formulas, cell->formula);
+    }
+    cell->formula = id;
+    jit_compile(sheet, cell, row * sheet->cols + col);
+}
+
+void clear_formula(struct Sheet* sheet, int row, int col) {
+    struct Cell* cell = cell_at(sheet, row * sheet->cols + col);
+    if (cell->formula >= 0) {
+        formula_release(&sheet->formulas, cell->formula);
+        cell->formula = -1;
+    }
+    jit_release(&sheet->jit, cell);
+}
+
+// Reads an operand of the formula at (row, col); returns 1 for a cell in error
+int operand_value(struct Sheet* sheet, int row, int col, Operand* operand, int* value) {
+    if (!operand->is_cell) {
+        *value = operand->value;
+        return 0;
+    }
+    if (error_at(sheet, row + operand->row, col + operand->col)) return 1;
+    *value = value_at(sheet, row + operand->row, col + operand->col);
+    return 0;
+}
+
+int arith_opcode(char op) {
+    switch (op) {
+        case '+': return 1;
+        case '-': return 2;
+        case '*': return 3;
+        case '/': return 4;
+        default: return 0;
+    }
+}
+
+int extreme_pick(int opcode, int a, int b) {
+    if (opcode == 1) return a < b ? a : b;
+    return a > b ? a : b;
+}
+
+// Scalar range kernels over one contiguous row run
+void extreme_run_scalar(const int* values, int count, int opcode, int* extreme) {
+    int result = *extreme;
+    for (int c = 0; c < count; c++) {
+        result = extreme_pick(opcode, result, values[c]);
+    }
+    *extreme = result;
+}
+
+void moments_run_scalar(const int* values, int count, long long* total, __int128* squares) {
+    long long run_total = 0;
+    __int128 run_squares = 0;
+    for (int c = 0; c < count; c++) {
+        run_total += values[c];
+        run_squares += (long long)values[c] * values[c];
+    }
+    *total += run_total;
+    *squares += run_squares;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("sse4.1")))
+void extreme_run_sse41(const int* values, int count, int opcode, int* extreme) {
+    __m128i best = _mm_set1_epi32(*extreme);
+    int c = 0;
+    for (; c + 4 <= count; c += 4) {
+        __m128i value = _mm_loadu_si128((const __m128i*)(values + c));
+        best = opcode == 1 ? _mm_min_epi32(best, value) : _mm_max_epi32(best, value);
+    }
+    int lanes[4];
+    _mm_storeu_si128((__m128i*)lanes, best);
+    for (int k = 0; k < 4; k++) {
+        *extreme = extreme_pick(opcode, *extreme, lanes[k]);
+    }
+    extreme_run_scalar(values + c, count - c, opcode, extreme);
+}
+
+__attribute__((target("sse4.1")))
+void moments_run_sse41(const int* values, int count, long long* total, __int128* squares) {
+    __m128i sum = _mm_setzero_si128(), high = _mm_setzero_si128(), low = _mm_setzero_si128();
+    __m128i mask = _mm_set1_epi64x(0xffffffff);
+    int c = 0;
+    for (; c + 4 <= count; c += 4) {
+        __m128i value = _mm_loadu_si128((const __m128i*)(values + c));
+        __m128i a = _mm_cvtepi32_epi64(value);
+        __m128i b = _mm_cvtepi32_epi64(_mm_srli_si128(value, 8));
+        sum = _mm_add_epi64(sum, _mm_add_epi64(a, b));
+        __m128i square_a = _mm_mul_epi32(a, a), square_b = _mm_mul_epi32(b, b);
+        high = _mm_add_epi64(high, _mm_add_epi64(_mm_srli_epi64(square_a, 32), _mm_srli_epi64(square_b, 32)));
+        low = _mm_add_epi64(low, _mm_add_epi64(_mm_and_si128(square_a, mask), _mm_and_si128(square_b, mask)));
+    }
+    long long sums[2];
+    unsigned long long highs[2], lows[2];
+    _mm_storeu_si128((__m128i*)sums, sum);
+    _mm_storeu_si128((__m128i*)highs, high);
+    _mm_storeu_si128((__m128i*)lows, low);
+    for (int k = 0; k < 2; k++) {
+        *total += sums[k];
+        *squares += ((__int128)highs[k] << 32) + lows[k];
+    }
+    moments_run_scalar(values + c, count - c, total, squares);
+}
+
+__attribute__((target("avx2")))
+void extreme_run_avx2(const int* values, int count, int opcode, int* extreme) {
+    __m256i best = _mm256_set1_epi32(*extreme);
+    int c = 0;
+    for (; c + 8 <= count; c += 8) {
+        __m256i value = _mm256_loadu_si256((const __m256i*)(values + c));
+        best = opcode == 1 ? _mm256_min_epi32(best, value) : _mm256_max_epi32(best, value);
+    }
+    int lanes[8];
+    _mm256_storeu_si256((__m256i*)lanes, best);
+    for (int k = 0; k < 8; k++) {
+        *extreme = extreme_pick(opcode, *extreme, lanes[k]);
+    }
+    extreme_run_scalar(values + c, count - c, opcode, extreme);
+}
+
+__attribute__((target("avx2")))
+void moments_run_avx2(const int* values, int count, long long* total, __int128* squares) {
+    __m256i sum = _mm256_setzero_si256(), high = _mm256_setzero_si256(), low = _mm256_setzero_si256();
+    __m256i mask = _mm256_set1_epi64x(0xffffffff);
+    int c = 0;
+    for (; c + 8 <= count; c += 8) {
+        __m256i value = _mm256_loadu_si256((const __m256i*)(values + c));
+        __m256i a = _mm256_cvtepi32_epi64(_mm256_castsi256_si128(value));
+        __m256i b = _mm256_cvtepi32_epi64(_mm256_extracti128_si256(value, 1));
+        sum = _mm256_add_epi64(sum, _mm256_add_epi64(a, b));
+        __m256i square_a = _mm256_mul_epi32(a, a), square_b = _mm256_mul_epi32(b, b);
+        high = _mm256_add_epi64(high, _mm256_add_epi64(_mm256_srli_epi64(square_a, 32), _mm256_srli_epi64(square_b, 32)));
+        low = _mm256_add_epi64(low, _mm256_add_epi64(_mm256_and_si256(square_a, mask), _mm256_and_si256(square_b, mask)));
+    }
+    long long sums[4];
+    unsigned long long highs[4], lows[4];
+    _mm256_storeu_si256((__m256i*)sums, sum);
+    _mm256_storeu_si256((__m256i*)highs, high);
+    _mm256_storeu_si256((__m256i*)lows, low);
+    for (int k = 0; k < 4; k++) {
+        *total += sums[k];
+        *squares += ((__int128)highs[k] << 32) + lows[k];
+    }
+    moments_run_scalar(values + c, count - c, total, squares);
+}
+
+__attribute__((target("avx512f")))
+void extreme_run_avx512(const int* values, int count, int opcode, int* extreme) {
+    __m512i best = _mm512_set1_epi32(*extreme);
+    int c = 0;
+    for (; c + 16 <= count; c += 16) {
+        __m512i value = _mm512_loadu_si512(values + c);
+        best = opcode == 1 ? _mm512_min_epi32(best, value) : _mm512_max_epi32(best, value);
+    }
+    *extreme = opcode == 1 ? _mm512_reduce_min_epi32(best) : _mm512_reduce_max_epi32(best);
+    extreme_run_scalar(values + c, count - c, opcode, extreme);
+}
+
+__attribute__((target("avx512f")))
+void moments_run_avx512(const int* values, int count, long long* total, __int128* squares) {
+    __m512i sum = _mm512_setzero_si512(), high = _mm512_setzero_si512(), low = _mm512_setzero_si512();
+    __m512i mask = _mm512_set1_epi64(0xffffffff);
+    int c = 0;
+    for (; c + 16 <= count; c += 16) {
+        __m512i value = _mm512_loadu_si512(values + c);
+        __m512i a = _mm512_cvtepi32_epi64(_mm512_castsi512_si256(value));
+        __m512i b = _mm512_cvtepi32_epi64(_mm512_extracti64x4_epi64(value, 1));
+        sum = _mm512_add_epi64(sum, _mm512_add_epi64(a, b));
+        __m512i square_a = _mm512_mul_epi32(a, a), square_b = _mm512_mul_epi32(b, b);
+        high = _mm512_add_epi64(high, _mm512_add_epi64(_mm512_srli_epi64(square_a, 32), _mm512_srli_epi64(square_b, 32)));
+        low = _mm512_add_epi64(low, _mm512_add_epi64(_mm512_and_si512(square_a, mask), _mm512_and_si512(square_b, mask)));
+    }
+    unsigned long long highs[8], lows[8];
+    _mm512_storeu_si512(highs, high);
+    _mm512_storeu_si512(lows, low);
+    *total += _mm512_reduce_add_epi64(sum);
+    for (int k = 0; k < 8; k++) {
+        *squares += ((__int128)highs[k] << 32) + lows[k];
+    }
+    moments_run_scalar(values + c, count - c, total, squares);
+}
+#endif
+
+// Picks the kernels once, from what the CPU reports
+void range_kernels_select(RangeKernels* kernels) {
+    kernels->extreme = extreme_run_scalar;
+    kernels->moments = moments_run_scalar;
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+        kernels->extreme = extreme_run_avx512;
+        kernels->moments = moments_run_avx512;
+    } else if (__builtin_cpu_supports("avx2")) {
+        kernels->extreme = extreme_run_avx2;
+        kernels->moments = moments_run_avx2;
+    } else if (__builtin_cpu_supports("sse4.1")) {
+        kernels->extreme = extreme_run_sse41;
+        kernels->moments = moments_run_sse41;
+    }
+#endif
+}
+
+// Folds row's cells in [start_col, end_col] into *extreme, one kernel call per tile
+void scan_row_extreme(struct Sheet* sheet, int row, int start_col, int end_col, int opcode, int* extreme) {
+    for (int c = start_col; c <= end_col; ) {
+        const int* run;
+        int count = value_run(sheet, row, c, end_col, &run);
+        sheet->kernels.extreme(run, count, opcode, extreme);
+        c += count;
+    }
+}
+
+void scan_row_moments(struct Sheet* sheet, int row, int start_col, int end_col,
+                      long long* total, __int128* squares) {
+    for (int c = start_col; c <= end_col; ) {
+        const int* run;
+        int count = value_run(sheet, row, c, end_col, &run);
+        sheet->kernels.moments(run, count, total, squares);
+        c += count;
+    }
+}
+
+// Extreme of the rectangle; returns 1 when it holds a cell in error
+int scan_extreme(struct Sheet* sheet, int start_row, int start_col, int end_row, int end_col,
+                 int opcode, int* result) {
+    if (range_has_error(sheet, start_row, start_col, end_row, end_col)) return 1;
+    int extreme = value_at(sheet, start_row, start_col);
+    for (int tr = start_row; tr <= end_row; tr = (tr | TILE_MASK) + 1) {
+        int tile_end_row = (tr | TILE_MASK) < end_row ? (tr | TILE_MASK) : end_row;
+        for (int tc = start_col; tc <= end_col; tc = (tc | TILE_MASK) + 1) {
+            if (!tile_present(sheet, tr, tc)) {
+                extreme = extreme_pick(opcode, extreme, 0);
+                continue;
+            }
+            int tile_end_col = (tc | TILE_MASK) < end_col ? (tc | TILE_MASK) : end_col;
+            for (int r = tr; r <= tile_end_row; r++) {
+                scan_row_extreme(sheet, r, tc, tile_end_col, opcode, &extreme);
+            }
+        }
+    }
+    *result = extreme;
+    return 0;
+}
+
+// Total, sum of squares and error count of the rectangle, skipping absent tiles
+void scan_moments(struct Sheet* sheet, int start_row, int start_col, int end_row, int end_col,
+                  long long* total, __int128* squares, int* errors) {
+    for (int tr = start_row; tr <= end_row; tr = (tr | TILE_MASK) + 1) {
+        int tile_end_row = (tr | TILE_MASK) < end_row ? (tr | TILE_MASK) : end_row;
+        for (int tc = start_col; tc <= end_col; tc = (tc | TILE_MASK) + 1) {
+            if (!tile_present(sheet, tr, tc)) continue;
+            int tile_end_col = (tc | TILE_MASK) < end_col ? (tc | TILE_MASK) : end_col;
+            for (int r = tr; r <= tile_end_row; r++) {
+                scan_row_moments(sheet, r, tc, tile_end_col, total, squares);
+                *errors += count_errors(sheet, r, tc, tile_end_col - tc + 1);
+            }
+        }
+    }
+}
+
+// SUM (4), AVG (3) or STDEV (5) of count cells from their moments
+int moments_value(int opcode, int count, long long total, __int128 squares) {
+    if (opcode == 4) return (int)total;
+    if (opcode == 5) return stdev_from_moments(count, total, squares);
+    return (int)((double)total / count);
+}
+
+// SUM, AVG or STDEV of idx's range from its moments, rescanned only when stale
+int evaluate_range_total(struct Sheet* sheet, int idx, int opcode, RangeAggregate* aggregate) {
+    int start_row = aggregate->bounds[0], start_col = aggregate->bounds[1];
+    int end_row = aggregate->bounds[2], end_col = aggregate->bounds[3];
+    if (!aggregate->valid) {
+        long long total = 0;
+        __int128 squares = 0;
+        int errors = 0;
+        int indexed = 1;
+        for (int c = start_col; c <= end_col && indexed; c++) {
+            indexed = sheet->columns[c] != NULL;
+        }
+        for (int c = start_col; c <= end_col && indexed; c++) {
+            column_index_query(sheet, c, start_row, end_row, &total, &squares, &errors);
+        }
+        if (!indexed) {
+            scan_moments(sheet, start_row, start_col, end_row, end_col, &total, &squares, &errors);
+        }
+        aggregate->total = total;
+        aggregate->squares = squares;
+        aggregate->errors = errors;
+        aggregate->valid = 1;
+    }
+    
+    if (aggregate->errors > 0) {
+        set_cell_error(sheet, idx, 1);
+        return 0;
+    }
+    int count = (end_row - start_row + 1) * (end_col - start_col + 1);
+    set_cell_value(sheet, idx, moments_value(opcode, count, aggregate->total, aggregate->squares));
+    return 0;
+}
+
+// MIN or MAX of a rectangle whose columns are all indexed
+int evaluate_range_extreme(struct Sheet* sheet, int idx, int opcode,
+                           int start_row, int start_col, int end_row, int end_col) {
+    long long total = 0;
+    __int128 squares = 0;
+    int errors = 0;
+    int extreme = 0;
+    for (int c = start_col; c <= end_col; c++) {
+        column_index_query(sheet, c, start_row, end_row, &total, &squares, &errors);
+        int value = column_index_extreme(sheet, c, start_row, end_row, opcode);
+        extreme = c == start_col ? value : extreme_pick(opcode, extreme, value);
+    }
+    if (errors > 0) {
+        set_cell_error(sheet, idx, 1);
+    } else {
+        set_cell_value(sheet, idx, extreme);
+    }
+    return 0;
+}
+
+// Drops the range state of every aggregate whose range covers (row, col)
+void invalidate_range_totals(struct Sheet* sheet, int row, int col) {
+    find_range_dependents(sheet, row, col, &sheet->range_hits);
+    for (int i = 0; i < sheet->range_hits.count; i++) {
+        RangeDependency* range = sheet->range_hits.items[i];
+        if (range->aggregate) {
+            range->aggregate->valid = 0;
+        }
+    }
+}
+
+// Saves the edited cell's result so the recalculation can pass on its delta
+void begin_edit(struct Sheet* sheet, int row, int col) {
+    if (sheet->edit_pending) {
+        int edited = sheet->edit_row * sheet->cols + sheet->edit_col;
+        if (cell_value(sheet, edited) != sheet->edit_value || cell_error(sheet, edited) != sheet->edit_error) {
+            invalidate_range_totals(sheet, sheet->edit_row, sheet->edit_col);
+        }
+        column_touch(sheet, sheet->edit_row, sheet->edit_col);
+    }
+    sheet->edit_pending = 1;
+    sheet->edit_row = row;
+    sheet->edit_col = col;
+    sheet->edit_value = value_at(sheet, row, col);
+    sheet->edit_error = error_at(sheet, row, col);
+}
+
+int evaluate_cell(struct Sheet* sheet, int row, int col) {
+    int idx = row * sheet->cols + col;
+    struct Cell* cell = cell_peek(sheet, idx);
+    if (cell->formula < 0) return 0;
+    Formula* formula = &sheet->formulas.items[cell->formula];
+    if (cell->jit_slot >= 0) {
+        return ((JitFunction)jit_code(&sheet->jit, cell->jit_slot))();
+    }
+    
+    set_error_at(sheet, row, col, 0);
+    
+    switch (formula->kind) {
+        case FORMULA_REF: {
+            int value;
+            if (operand_value(sheet, row, col, &formula->left, &value)) {
+                set_error_at(sheet, row, col, 1);
+            } else {
+                set_value_at(sheet, row, col, value);
+            }
+            return 0;
+        }
+        
+        case FORMULA_ARITH: {
+            int val1, val2;
+            int left_has_error = operand_value(sheet, row, col, &formula->left, &val1);
+            int right_has_error = operand_value(sheet, row, col, &formula->right, &val2);
+            if (left_has_error || right_has_error) {
+                set_error_at(sheet, row, col, 1);
+                return 0;
+            }
+            return setarith(sheet, idx, val1, val2, formula->opcode) != 0;
+        }
+        
+        case FORMULA_SLEEP: {
+            int sleep_time;
+            if (operand_value(sheet, row, col, &formula->left, &sleep_time)) {
+                set_error_at(sheet, row, col, 1);
+                return 0;
+            }
+            if (sleep_time <= 0) {
+                set_error_at(sheet, row, col, 1);
+                return 1;
+            }
+            sleep(sleep_time);
+            set_value_at(sheet, row, col, sleep_time);
+            return 0;
+        }
+        
+        case FORMULA_FUNC:
+            break;
+    }
+    
+    int start_row = row + formula->start_row;
+    int start_col = col + formula->start_col;
+    int end_row = row + formula->end_row;
+    int end_col = col + formula->end_col;
+    RangeDependency* range = cell->depends_on_range;
+    if (range && range->aggregate) {
+        return evaluate_range_total(sheet, idx, formula->opcode, range->aggregate);
+    }
+    // MIN/MAX from the column indexes when all are built, else by a scan
+    if (formula->opcode == 1 || formula->opcode == 2) {
+        int indexed = 1;
+        for (int c = start_col; c <= end_col && indexed; c++) {
+            indexed = sheet->columns[c] != NULL;
+        }
+        if (indexed) {
+            return evaluate_range_extreme(sheet, idx, formula->opcode, start_row, start_col, end_row, end_col);
+        }
+        int extreme;
+        if (scan_extreme(sheet, start_row, start_col, end_row, end_col, formula->opcode, &extreme)) {
+            set_error_at(sheet, row, col, 1);
+        } else {
+            set_value_at(sheet, row, col, extreme);
+        }
+        return 0;
+    }
+    if (range_has_error(sheet, start_row, start_col, end_row, end_col)) {
+        set_error_at(sheet, row, col, 1);
+        return 0;
+    }
+    long long total = 0;
+    __int128 squares = 0;
+    int errors = 0;
+    scan_moments(sheet, start_row, start_col, end_row, end_col, &total, &squares, &errors);
+    int count = (end_row - start_row + 1) * (end_col - start_col + 1);
+    set_value_at(sheet, row, col, moments_value(formula->opcode, count, total, squares));
+    return 0;
+}
+
+
+// Pearce-Kelly order: every edge between ranked cells runs from lower rank to higher
+#define RANK_FORWARD 1
+#define RANK_BACKWARD 2
+#define RANK_SEED 4
+
+
+void rank_mark(struct Sheet* sheet, int idx, int flag) {
+    struct Cell* cell = cell_at(sheet, idx);
+    if (!cell->rank_mark) {
+        worklist_push(&sheet->rank_touched, idx);
+    }
+    cell->rank_mark |= flag;
+}
+
+void rank_clear_marks(struct Sheet* sheet) {
+    for (int i = 0; i < sheet->rank_touched.count; i++) {
+        cell_at(sheet, sheet->rank_touched.items[i])->rank_mark = 0;
+    }
+    sheet->rank_touched.count = 0;
+    sheet->rank_forward.count = 0;
+    sheet->rank_backward.count = 0;
+}
+
+// Extends rank_forward up to rank upper; returns 1 on reaching a RANK_SEED cell
+int rank_search_forward(struct Sheet* sheet, int upper) {
+    Worklist* stack = &sheet->worklist;
+    while (stack->count > 0) {
+        int idx = stack->items[--stack->count];
+        find_range_dependents(sheet, idx / sheet->cols, idx % sheet->cols, &sheet->range_hits);
+        int point_count;
+        int* slots = dependent_slots(sheet, idx, &point_count);
+        for (int i = 0; i < point_count + sheet->range_hits.count; i++) {
+            int next;
+            if (i < point_count) {
+                next = slots[i];
+                if (next < 0) continue;
+            } else {
+                RangeDependency* range = sheet->range_hits.items[i - point_count];
+                next = range->row * sheet->cols + range->col;
+            }
+            struct Cell* next_cell = cell_peek(sheet, next);
+            if (!next_cell->ranked || next_cell->rank > upper) continue;
+            if (next_cell->rank_mark & RANK_SEED) return 1;
+            if (next_cell->rank_mark & RANK_FORWARD) continue;
+            rank_mark(sheet, next, RANK_FORWARD);
+            worklist_push(&sheet->rank_forward, next);
+            worklist_push(stack, next);
+        }
+    }
+    return 0;
+}
+
+// Ranked cells of the range above rank lower, into ranked_hits
+void find_ranked_in_range(struct Sheet* sheet, RangeDependency* range, int lower) {
+    Worklist* hits = &sheet->ranked_hits;
+    hits->count = 0;
+    for (int tile_row = range->start_row >> TILE_SHIFT; tile_row <= range->end_row >> TILE_SHIFT; tile_row++) {
+        int first_row = tile_row << TILE_SHIFT;
+        int start_row = range->start_row > first_row ? range->start_row : first_row;
+        int end_row = range->end_row < first_row + TILE_MASK ? range->end_row : first_row + TILE_MASK;
+        for (int tile_col = range->start_col >> TILE_SHIFT; tile_col <= range->end_col >> TILE_SHIFT; tile_col++) {
+            Tile* tile = sheet->tiles[tile_row * sheet->tile_cols + tile_col];
+            if (!tile) continue;
+            int first_col = tile_col << TILE_SHIFT;
+            int low = range->start_col > first_col ? range->start_col - first_col : 0;
+            int high = range->end_col < first_col + TILE_MASK ? range->end_col - first_col : TILE_MASK;
+            unsigned long long mask = (~0ULL >> (63 - high)) & (~0ULL << low);
+            for (int r = start_row; r <= end_row; r++) {
+                unsigned long long word = tile->ranked[r & TILE_MASK] & mask;
+                while (word) {
+                    int idx = r * sheet->cols + first_col + __builtin_ctzll(word);
+                    word &= word - 1;
+                    if (cell_peek(sheet, idx)->rank > lower) {
+                        worklist_push(hits, idx);
+                    }
+                }
+            }
+        }
+    }
+}
+
+// Extends rank_backward with the ranked cells above rank lower
+void rank_search_backward(struct Sheet* sheet, int lower) {
+    Worklist* stack = &sheet->worklist;
+    while (stack->count > 0) {
+        int idx = stack->items[--stack->count];
+        struct Cell* cell = cell_peek(sheet, idx);
+        int point_count = cell->depends_on.capacity;
+        sheet->ranked_hits.count = 0;
+        if (cell->depends_on_range) {
+            find_ranked_in_range(sheet, cell->depends_on_range, lower);
+        }
+        for (int i = 0; i < point_count + sheet->ranked_hits.count; i++) {
+            int prev;
+            if (i < point_count) {
+                prev = cell->depends_on.slots[i];
+                if (prev < 0) continue;
+            } else {
+                prev = sheet->ranked_hits.items[i - point_count];
+            }
+            struct Cell* prev_cell = cell_peek(sheet, prev);
+            if (!prev_cell->ranked || prev_cell->rank <= lower) continue;
+            if (prev_cell->rank_mark & RANK_BACKWARD) continue;
+            rank_mark(sheet, prev, RANK_BACKWARD);
+            worklist_push(&sheet->rank_backward, prev);
+            worklist_push(stack, prev);
+        }
+    }
+}
+
+int compare_rank_keys(const void* a, const void* b) {
+    long long x = *(const long long*)a;
+    long long y = *(const long long*)b;
+    return (x > y) - (x < y);
+}
+
+// Moves rank_backward before rank_forward; returns 1 when out of memory
+int rank_reorder(struct Sheet* sheet) {
+    int nb = sheet->rank_backward.count;
+    int nf = sheet->rank_forward.count;
+    long long* keys = malloc((nb + nf) * sizeof(long long));
+    long long* pool = malloc((nb + nf) * sizeof(long long));
+    if (!keys || !pool) {
+        free(keys);
+        free(pool);
+        printf("Memory allocation failed\n");
+        return 1;
+    }
+    
+    // Key = rank in the high half, cell index in the low half
+    for (int i = 0; i < nb + nf; i++) {
+        int idx = i < nb ? sheet->rank_backward.items[i] : sheet->rank_forward.items[i - nb];
+        keys[i] = ((long long)cell_at(sheet, idx)->rank << 32) | (unsigned int)idx;
+        pool[i] = keys[i];
+    }
+    qsort(keys, nb, sizeof(long long), compare_rank_keys);
+    qsort(keys + nb, nf, sizeof(long long), compare_rank_keys);
+    qsort(pool, nb + nf, sizeof(long long), compare_rank_keys);
+    for (int i = 0; i < nb + nf; i++) {
+        cell_at(sheet, (int)(keys[i] & 0xffffffff))->rank = (int)(pool[i] >> 32);
+    }
+    free(keys);
+    free(pool);
+    return 0;
+}
+
+// Whether a ranked cell has an edge from (row, col)
+int rank_has_dependent(struct Sheet* sheet, int row, int col) {
+    int point_count;
+    int* slots = dependent_slots(sheet, row * sheet->cols + col, &point_count);
+    for (int i = 0; i < point_count; i++) {
+        if (slots[i] >= 0 && cell_peek(sheet, slots[i])->ranked) return 1;
+    }
+    find_range_dependents(sheet, row, col, &sheet->range_hits);
+    for (int i = 0; i < sheet->range_hits.count; i++) {
+        RangeDependency* range = sheet->range_hits.items[i];
+        if (cell_peek(sheet, range->row * sheet->cols + range->col)->ranked) return 1;
+    }
+    return 0;
+}
+
+// Whether a ranked cell has an edge into cell
+int rank_has_precedent(struct Sheet* sheet, struct Cell* cell) {
+    for (int i = 0; i < cell->depends_on.capacity; i++) {
+        int prev = cell->depends_on.slots[i];
+        if (prev >= 0 && cell_peek(sheet, prev)->ranked) return 1;
+    }
+    if (cell->depends_on_range) {
+        find_ranked_in_range(sheet, cell->depends_on_range, 0);
+        return sheet->ranked_hits.count > 0;
+    }
+    return 0;
+}
+
+// Ranks a cell; returns 1 and flags it cyclic on a cycle or when out of memory
+int rank_cell(struct Sheet* sheet, int row, int col) {
+    int v = row * sheet->cols + col;
+    struct Cell* cell = cell_at(sheet, row * sheet->cols + col);
+    
+    cellset_remove(&sheet->cyclic_cells, v);
+    cell->cyclic = 0;
+    set_cell_ranked(sheet, v, 0);
+    RangeDependency* range = cell->depends_on_range;
+    if (cell->depends_on.count == 0 && !range) return 0;
+    
+    // A new cell takes a fresh rank at the end that needs no repair
+    if (cell->rank == 0) {
+        if (rank_has_dependent(sheet, row, col) && !rank_has_precedent(sheet, cell)) {
+            cell->rank = --sheet->rank_low;
+        } else {
+            cell->rank = ++sheet->rank_high;
+        }
+    }
+    
+    // Ranked dependents before the cell move after it
+    int failed = 0;
+    find_range_dependents(sheet, row, col, &sheet->range_hits);
+    int point_count;
+    int* slots = dependent_slots(sheet, v, &point_count);
+    for (int i = 0; i < point_count + sheet->range_hits.count; i++) {
+        int next;
+        if (i < point_count) {
+            next = slots[i];
+            if (next < 0) continue;
+        } else {
+            next = sheet->range_hits.items[i - point_count]->row * sheet->cols +
+                   sheet->range_hits.items[i - point_count]->col;
+        }
+        struct Cell* next_cell = cell_peek(sheet, next);
+        if (next == v || !next_cell->ranked || next_cell->rank > cell->rank) continue;
+        if (next_cell->rank_mark & RANK_FORWARD) continue;
+        rank_mark(sheet, next, RANK_FORWARD);
+        worklist_push(&sheet->rank_forward, next);
+    }
+    if (sheet->rank_forward.count > 0) {
+        sheet->worklist.count = 0;
+        for (int i = 0; i < sheet->rank_forward.count; i++) {
+            worklist_push(&sheet->worklist, sheet->rank_forward.items[i]);
+        }
+        rank_search_forward(sheet, cell->rank);
+        worklist_push(&sheet->rank_backward, v);
+        failed = rank_reorder(sheet);
+    }
+    rank_clear_marks(sheet);
+    if (failed) {
+        cell->cyclic = 1;
+        cellset_insert(&sheet->cyclic_cells, v);
+        return 1;
+    }
+    
+    // Ranked precedents after the cell seed the backward search
+    int upper = cell->rank;
+    int self_loop = range && row >= range->start_row && row <= range->end_row &&
+                    col >= range->start_col && col <= range->end_col;
+    int precedent_count = cell->depends_on.capacity;
+    sheet->ranked_hits.count = 0;
+    if (range && !self_loop) {
+        find_ranked_in_range(sheet, range, cell->rank);
+    }
+    for (int i = 0; i < precedent_count + sheet->ranked_hits.count && !self_loop; i++) {
+        int prev;
+        if (i < precedent_count) {
+            prev = cell->depends_on.slots[i];
+            if (prev < 0) continue;
+        } else {
+            prev = sheet->ranked_hits.items[i - precedent_count];
+        }
+        struct Cell* prev_cell = cell_peek(sheet, prev);
+        if (prev == v) {
+            self_loop = 1;
+        } else if (prev_cell->ranked && prev_cell->rank > cell->rank &&
+                   !(prev_cell->rank_mark & RANK_SEED)) {
+            rank_mark(sheet, prev, RANK_SEED | RANK_BACKWARD);
+            worklist_push(&sheet->rank_backward, prev);
+            if (prev_cell->rank > upper) upper = prev_cell->rank;
+        }
+    }
+    
+    int has_cycle = self_loop;
+    if (!has_cycle && sheet->rank_backward.count > 0) {
+        rank_mark(sheet, v, RANK_FORWARD);
+        worklist_push(&sheet->rank_forward, v);
+        sheet->worklist.count = 0;
+        worklist_push(&sheet->worklist, v);
+        has_cycle = rank_search_forward(sheet, upper);
+        if (!has_cycle) {
+            sheet->worklist.count = 0;
+            for (int i = 0; i < sheet->rank_backward.count; i++) {
+                worklist_push(&sheet->worklist, sheet->rank_backward.items[i]);
+            }
+            rank_search_backward(sheet, cell->rank);
+            has_cycle = rank_reorder(sheet);
+        }
+    }
+    rank_clear_marks(sheet);
+    
+    if (has_cycle) {
+        cell->cyclic = 1;
+        cellset_insert(&sheet->cyclic_cells, v);
+        return 1;
+    }
+    set_cell_ranked(sheet, v, 1);
+    return 0;
+}
+
+// Marks a cell dirty for the current epoch, 1 when out of memory
+int mark_dirty(struct Sheet* sheet, int idx) {
+    struct Cell* cell = cell_at(sheet, idx);
+    if (cell->dirty_epoch != sheet->epoch) {
+        cell->dirty_epoch = sheet->epoch;
+        cell->in_degree = 0;
+        cell->input_changed = 0;
+        return worklist_push(&sheet->dirty, idx);
+    }
+    return 0;
+}
+
+// Puts the collected cells in error when the pass cannot run
+void fail_dirty_set(struct Sheet* sheet) {
+    Worklist* dirty = &sheet->dirty;
+    printf("Memory allocation failed\n");
+    for (int i = 1; i < dirty->count; i++) {
+        struct Cell* cell = cell_peek(sheet, dirty->items[i]);
+        set_cell_error(sheet, dirty->items[i], 1);
+        if (cell->depends_on_range && cell->depends_on_range->aggregate) {
+            cell->depends_on_range->aggregate->valid = 0;
+        }
+        column_touch(sheet, dirty->items[i] / sheet->cols, dirty->items[i] % sheet->cols);
+    }
+}
+
+void next_epoch(struct Sheet* sheet) {
+    if (++sheet->epoch == 0) {
+        // Wrapped around: old stamps could now collide with new epochs
+        for (int p = 0; p < sheet->record_pages; p++) {
+            for (int k = 0; sheet->records[p] && k < RECORD_PAGE_SIZE; k++) {
+                if (sheet->records[p][k]) {
+                    sheet->records[p][k]->dirty_epoch = 0;
+                }
+            }
+        }
+        sheet->epoch = 1;
+    }
+}
+
+// Vertical runs of one +, - or * formula in a frontier are evaluated as blocks
+#define BATCH_MIN_RUN 8
+#define BATCH_BLOCK 256
+
+typedef unsigned int BatchVector __attribute__((vector_size(32)));
+#define BATCH_LANES (int)(sizeof(BatchVector) / sizeof(unsigned int))
+
+// RECALC_* flags recorded per Kahn queue entry
+#define RECALC_CHANGED 1     // value or error state differs from before
+#define RECALC_OLD_ERROR 2   // the cell was in error before
+#define RECALC_UNKNOWN 4     // the previous result is not known
+
+int recalc_flags(int changed, int old_error) {
+    return (changed ? RECALC_CHANGED : 0) | (old_error ? RECALC_OLD_ERROR : 0);
+}
+
+// Recalculates the cell at queue position pos and records its old result
+void recalc_cell(struct Sheet* sheet, int pos, int root) {
+    int idx = sheet->order.items[pos];
+    struct Cell* cell = cell_peek(sheet, idx);
+    int row, col;
+    cell_coords(sheet, idx, &row, &col);
+    int old_value = value_at(sheet, row, col);
+    int old_error = error_at(sheet, row, col);
+    if (cell->cyclic) {
+        set_error_at(sheet, row, col, 1);
+    } else if (idx != root && cell->input_changed) {
+        evaluate_cell(sheet, row, col);
+    }
+    
+    int flags = recalc_flags(value_at(sheet, row, col) != old_value || error_at(sheet, row, col) != old_error, old_error);
+    if (idx == root) {
+        // The handler already computed the edited cell
+        flags = RECALC_CHANGED | RECALC_UNKNOWN;
+        if (sheet->edit_pending && sheet->edit_row * sheet->cols + sheet->edit_col == root) {
+            old_value = sheet->edit_value;
+            flags = recalc_flags(1, sheet->edit_error);
+        }
+    }
+    sheet->changed.items[pos] = flags;
+    sheet->old_values.items[pos] = old_value;
+}
+
+int batchable(struct Sheet* sheet, int idx, int root) {
+    struct Cell* cell = cell_peek(sheet, idx);
+    if (idx == root || cell->cyclic || !cell->input_changed || cell->formula < 0) return 0;
+    Formula* formula = &sheet->formulas.items[cell->formula];
+    if (formula->kind == FORMULA_FUNC) return cell->depends_on_range != NULL;
+    return formula->kind == FORMULA_ARITH && formula->opcode >= 1 && formula->opcode <= 3;
+}
+
+void gather_operand(struct Sheet* sheet, Operand* operand, int first_row, int col, int count,
+                    unsigned int* values, unsigned int* errors) {
+    if (!operand->is_cell) {
+        for (int i = 0; i < count; i++) {
+            values[i] = (unsigned int)operand->value;
+            errors[i] = 0;
+        }
+        return;
+    }
+    for (int i = 0; i < count; i++) {
+        int source_row = first_row + i + operand->row;
+        values[i] = (unsigned int)value_at(sheet, source_row, col + operand->col);
+        errors[i] = error_at(sheet, source_row, col + operand->col) ? ~0u : 0;
+    }
+}
+
+// Evaluates count <= BATCH_BLOCK rows of col from first_row, recording RECALC_* flags
+void evaluate_block(struct Sheet* sheet, Formula* formula, int first_row, int col, int count,
+                    int* flags, int* old_values) {
+    BatchVector left[BATCH_BLOCK / BATCH_LANES], right[BATCH_BLOCK / BATCH_LANES];
+    BatchVector left_error[BATCH_BLOCK / BATCH_LANES], right_error[BATCH_BLOCK / BATCH_LANES];
+    BatchVector result[BATCH_BLOCK / BATCH_LANES], error[BATCH_BLOCK / BATCH_LANES];
+    gather_operand(sheet, &formula->left, first_row, col, count, (unsigned int*)left, (unsigned int*)left_error);
+    gather_operand(sheet, &formula->right, first_row, col, count, (unsigned int*)right, (unsigned int*)right_error);
+    
+    int vectors = (count + BATCH_LANES - 1) / BATCH_LANES;
+    for (int i = 0; i < vectors; i++) {
+        switch (formula->opcode) {
+            case 1: result[i] = left[i] + right[i]; break;
+            case 2: result[i] = left[i] - right[i]; break;
+            default: result[i] = left[i] * right[i]; break;
+        }
+        error[i] = left_error[i] | right_error[i];
+    }
+    
+    unsigned int* results = (unsigned int*)result;
+    unsigned int* errors = (unsigned int*)error;
+    for (int i = 0; i < count; i++) {
+        int row = first_row + i;
+        int old_value = value_at(sheet, row, col);
+        int old_error = error_at(sheet, row, col);
+        if (!errors[i]) {
+            set_value_at(sheet, row, col, (int)results[i]);
+        }
+        set_error_at(sheet, row, col, errors[i] != 0);
+        flags[i] = recalc_flags(value_at(sheet, row, col) != old_value || (errors[i] != 0) != old_error, old_error);
+        old_values[i] = old_value;
+    }
+}
+
+// A run of one range function down a column as rolling windows, 1 when out of memory
+int evaluate_window_block(struct Sheet* sheet, Formula* formula, int first_row, int col, int count,
+                          int* flags, int* old_values) {
+    int height = formula->end_row - formula->start_row + 1;
+    int start_col = col + formula->start_col;
+    int end_col = col + formula->end_col;
+    int source_row = first_row + formula->start_row;
+    int rows = count - 1 + height;
+    long long* totals = malloc((rows + 1) * sizeof(long long));
+    __int128* squares = malloc((rows + 1) * sizeof(__int128));
+    int* errors = malloc((rows + 1) * sizeof(int));
+    int* extremes = malloc(rows * sizeof(int));
+    int* deque = malloc(rows * sizeof(int));
+    if (!totals || !squares || !errors || !extremes || !deque) {
+        free(totals);
+        free(squares);
+        free(errors);
+        free(extremes);
+        free(deque);
+        return 1;
+    }
+    
+    int opcode = formula->opcode;
+    totals[0] = 0;
+    squares[0] = 0;
+    errors[0] = 0;
+    for (int j = 0; j < rows; j++) {
+        long long total = 0;
+        __int128 square = 0;
+        int error = count_errors(sheet, source_row + j, start_col, end_col - start_col + 1);
+        int extreme = value_at(sheet, source_row + j, start_col);
+        if (opcode == 1 || opcode == 2) {
+            scan_row_extreme(sheet, source_row + j, start_col, end_col, opcode, &extreme);
+        } else {
+            scan_row_moments(sheet, source_row + j, start_col, end_col, &total, &square);
+        }
+        totals[j + 1] = totals[j] + total;
+        squares[j + 1] = squares[j] + square;
+        errors[j + 1] = errors[j] + error;
+        extremes[j] = extreme;
+    }
+    
+    int cells = height * (end_col - start_col + 1);
+    int head = 0, tail = 0;
+    for (int j = 0; j < rows; j++) {
+        if (opcode == 1 || opcode == 2) {
+            while (tail > head && extreme_pick(opcode, extremes[deque[tail - 1]], extremes[j]) == extremes[j]) {
+                tail--;
+            }
+            deque[tail++] = j;
+        }
+        int i = j - height + 1;
+        if (i < 0) continue;
+        if (tail > head && deque[head] < i) head++;
+        
+        int row = first_row + i;
+        struct Cell* cell = cell_peek(sheet, row * sheet->cols + col);
+        int old_value = value_at(sheet, row, col);
+        int old_error = error_at(sheet, row, col);
+        long long total = totals[j + 1] - totals[i];
+        __int128 square = squares[j + 1] - squares[i];
+        int error = errors[j + 1] - errors[i];
+        set_error_at(sheet, row, col, error > 0);
+        if (error == 0) {
+            if (opcode == 1 || opcode == 2) {
+                set_value_at(sheet, row, col, extremes[deque[head]]);
+            } else {
+                set_value_at(sheet, row, col, moments_value(opcode, cells, total, square));
+            }
+        }
+        // Seed the shared range state from the window
+        RangeAggregate* aggregate = cell->depends_on_range->aggregate;
+        if (aggregate) {
+            aggregate->total = total;
+            aggregate->squares = square;
+            aggregate->errors = error;
+            aggregate->valid = 1;
+        }
+        flags[i] = recalc_flags(value_at(sheet, row, col) != old_value || (error > 0) != old_error, old_error);
+        old_values[i] = old_value;
+    }
+    
+    free(totals);
+    free(squares);
+    free(errors);
+    free(extremes);
+    free(deque);
+    return 0;
+}
+
+// Recalculates the frontier [first, last) into sheet->changed and old_values
+void recalc_frontier(struct Sheet* sheet, int first, int last, int root) {
+    int* order = sheet->order.items;
+    int* changed = sheet->changed.items;
+    int batching = last - first >= BATCH_MIN_RUN;
+    
+    for (int i = first; i < last; i++) {
+        if (i + 1 < last) {
+            __builtin_prefetch(cell_peek(sheet, order[i + 1]));
+        }
+        if (batching && batchable(sheet, order[i], root)) {
+            cell_at(sheet, order[i])->batch_pos = i + 1;
+        } else {
+            recalc_cell(sheet, i, root);
+        }
+    }
+    if (!batching) return;
+    
+    // Each run is handled from its top cell
+    int block_flags[BATCH_BLOCK];
+    int block_values[BATCH_BLOCK];
+    for (int i = first; i < last; i++) {
+        struct Cell* cell = cell_peek(sheet, order[i]);
+        if (cell->batch_pos != i + 1) continue;
+        int row = order[i] / sheet->cols;
+        int col = order[i] % sheet->cols;
+        if (row > 0 && cell_peek(sheet, (row - 1) * sheet->cols + col)->batch_pos &&
+            cell_peek(sheet, (row - 1) * sheet->cols + col)->formula == cell->formula) continue;
+        
+        int formula = cell->formula;
+        while (row < sheet->rows && cell_peek(sheet, row * sheet->cols + col)->batch_pos &&
+               cell_peek(sheet, row * sheet->cols + col)->formula == formula) {
+            int count = 0;
+            while (count < BATCH_BLOCK && row + count < sheet->rows &&
+                   cell_peek(sheet, (row + count) * sheet->cols + col)->batch_pos &&
+                   cell_peek(sheet, (row + count) * sheet->cols + col)->formula == formula) {
+                count++;
+            }
+            Formula* shared = &sheet->formulas.items[formula];
+            int batched = count >= BATCH_MIN_RUN;
+            if (batched && shared->kind == FORMULA_FUNC) {
+                batched = !evaluate_window_block(sheet, shared, row, col, count, block_flags, block_values);
+            } else if (batched) {
+                evaluate_block(sheet, shared, row, col, count, block_flags, block_values);
+            }
+            for (int k = 0; k < count; k++) {
+                struct Cell* member = cell_at(sheet, (row + k) * sheet->cols + col);
+                int pos = member->batch_pos - 1;
+                member->batch_pos = 0;
+                if (batched) {
+                    changed[pos] = block_flags[k];
+                    sheet->old_values.items[pos] = block_values[k];
+                } else {
+                    recalc_cell(sheet, pos, root);
+                }
+            }
+            row += count;
+        }
+    }
+}
+
+int update_dependencies(struct Sheet* sheet, int row, int col) {
+    // Place the modified cell in the topological order
+    if (rank_cell(sheet, row, col)) {
+        set_error_at(sheet, row, col, 1);
+    }
+    column_touch(sheet, row, col);
+    
+    if (sheet->jit.pending.count >= JIT_BATCH_SIZE) {
+        jit_flush(sheet);
+    }
+    
+    // Fold the overlay back into the packed graph once it stops being small
+    DependentsCSR* csr = &sheet->frozen;
+    if (csr->cells && csr->stale.count > CSR_MAX_STALE + csr->edge_count / 8) {
+        csr_compact(sheet);
+    }
+    
+    // Collect the dirty set, counting each cell's dirty precedents in in_degree
+    next_epoch(sheet);
+    Worklist* dirty = &sheet->dirty;
+    Worklist* order = &sheet->order;
+    dirty->count = 0;
+    order->count = 0;
+    int root = row * sheet->cols + col;
+    int failed = mark_dirty(sheet, root);
+    for (int head = 0; head < dirty->count; head++) {
+        int r, c;
+        cell_coords(sheet, dirty->items[head], &r, &c);
+        int point_count;
+        int* slots = dependent_slots(sheet, dirty->items[head], &point_count);
+        for (int i = 0; i < point_count; i++) {
+            int idx = slots[i];
+            if (idx < 0) continue;
+            failed |= mark_dirty(sheet, idx);
+            cell_at(sheet, idx)->in_degree++;
+        }
+        find_range_dependents(sheet, r, c, &sheet->range_hits);
+        for (int i = 0; i < sheet->range_hits.count; i++) {
+            RangeDependency* range = sheet->range_hits.items[i];
+            int idx = range->row * sheet->cols + range->col;
+            failed |= mark_dirty(sheet, idx);
+            cell_at(sheet, range->row * sheet->cols + range->col)->in_degree++;
+        }
+    }
+    
+    // Size the pass's scratch before anything is recalculated
+    if (failed || worklist_reserve(order, dirty->count) ||
+        worklist_reserve(&sheet->changed, dirty->count) ||
+        worklist_reserve(&sheet->old_values, dirty->count)) {
+        fail_dirty_set(sheet);
+        return 1;
+    }
+    
+    // Retry the stuck formulas this edit reaches
+    if (sheet->cyclic_cells.count > 0) {
+        for (int i = 1; i < dirty->count; i++) {
+            if (cell_peek(sheet, dirty->items[i])->cyclic) {
+                int r, c;
+                cell_coords(sheet, dirty->items[i], &r, &c);
+                rank_cell(sheet, r, c);
+            }
+        }
+    }
+    
+    // Kahn's algorithm, re-evaluating a cell only when a precedent changed
+    cell_at(sheet, row * sheet->cols + col)->input_changed = 1;
+    if (cell_at(sheet, row * sheet->cols + col)->in_degree == 0) {
+        worklist_push(order, root);
+    }
+    // Recalculate a whole frontier before any of it releases dependents
+    int level_end = 0;
+    for (int head = 0; head < order->count; head++) {
+        if (head == level_end) {
+            level_end = order->count;
+            while (sheet->changed.count < level_end) {
+                worklist_push(&sheet->changed, 0);
+            }
+            while (sheet->old_values.count < level_end) {
+                worklist_push(&sheet->old_values, 0);
+            }
+            recalc_frontier(sheet, head, level_end, root);
+        }
+        int r, c;
+        cell_coords(sheet, order->items[head], &r, &c);
+        int flags = sheet->changed.items[head];
+        int changed = flags & RECALC_CHANGED;
+        // Queued even when unchanged, as a query may have read it mid-evaluation
+        column_touch(sheet, r, c);
+        int value = value_at(sheet, r, c);
+        long long delta = (long long)value - sheet->old_values.items[head];
+        int error_delta = error_at(sheet, r, c) - ((flags & RECALC_OLD_ERROR) != 0);
+        unsigned int stamp = next_aggregate_stamp(sheet);
+        
+        int point_count;
+        int* slots = dependent_slots(sheet, order->items[head], &point_count);
+        for (int i = 0; i < point_count; i++) {
+            int idx = slots[i];
+            if (idx < 0) continue;
+            struct Cell* next = cell_at(sheet, idx);
+            next->input_changed |= changed;
+            if (--next->in_degree == 0) {
+                worklist_push(order, idx);
+            }
+        }
+        find_range_dependents(sheet, r, c, &sheet->range_hits);
+        for (int i = 0; i < sheet->range_hits.count; i++) {
+            RangeDependency* range = sheet->range_hits.items[i];
+            struct Cell* next = cell_at(sheet, range->row * sheet->cols + range->col);
+            next->input_changed |= changed;
+            RangeAggregate* aggregate = range->aggregate;
+            if (aggregate && aggregate->stamp != stamp) {
+                aggregate->stamp = stamp;
+                if (flags & RECALC_UNKNOWN) {
+                    aggregate->valid = 0;
+                } else if (changed && aggregate->valid) {
+                    int old_value = sheet->old_values.items[head];
+                    aggregate->errors += error_delta;
+                    aggregate->total += delta;
+                    aggregate->squares += (long long)value * value - (long long)old_value * old_value;
+                }
+            }
+            if (--next->in_degree == 0) {
+                worklist_push(order, range->row * sheet->cols + range->col);
+            }
+        }
+    }
+    
+    // Cells never made ready are on or behind a cycle, with stale range totals
+    for (int i = 0; i < dirty->count; i++) {
+        struct Cell* cell = cell_at(sheet, dirty->items[i]);
+        if (cell->in_degree > 0) {
+            set_cell_error(sheet, dirty->items[i], 1);
+            if (cell->depends_on_range && cell->depends_on_range->aggregate) {
+                cell->depends_on_range->aggregate->valid = 0;
+            }
+            column_touch(sheet, dirty->items[i] / sheet->cols, dirty->items[i] % sheet->cols);
+        }
+    }
+    if (sheet->edit_pending && sheet->edit_row == row && sheet->edit_col == col) {
+        sheet->edit_pending = 0;
+    }
+    return 0;
+}
+
+
+void sleep(int seconds) {
+    clock_t end_time = clock() + seconds * CLOCKS_PER_SEC;
+    while (clock() < end_time) {
+        // Busy wait
+    }
+}
+
+int handle_setfunc(struct Sheet* sheet, char* target_cell_ref, char* range_str, int opcode) {
+    int target_row = 0, target_col = 0;
+
+    int i = 0;
+    while(target_cell_ref[i] >= 'A' && target_cell_ref[i] <= 'Z') {
+        target_col = target_col * 26 + (target_cell_ref[i] - 'A' + 1);
+        i++;
+    }
+    target_col--; // Convert to 0-based indexing
+    target_row = atoi(target_cell_ref + i) - 1; // -1 for 0-based indexing
+    
+   
+    if(target_row < 0 || target_row >= sheet->rows || 
+       target_col < 0 || target_col >= sheet->cols) {
+        return 1; 
+    }
+    
+   
+    begin_edit(sheet, target_row, target_col);
+    set_error_at(sheet, target_row, target_col, 0);
+
+    clear_dependencies(sheet, target_row, target_col);
+
+    if (opcode == 6) {  // SLEEP
+        int sleep_time;
+        int sleep_row = -1, sleep_col = 0;
+        
+        // Check if range_str is a cell reference
+        if (range_str[0] >= 'A' && range_str[0] <= 'Z') {
+            int source_row = 0, source_col = 0;
+            int j = 0;
+            while (range_str[j] >= 'A' && range_str[j] <= 'Z') {
+                source_col = source_col * 26 + (range_str[j] - 'A' + 1);
+                j++;
+            }
+            source_col--;
+            source_row = atoi(range_str + j) - 1;
+            
+            if (source_row < 0 || source_row >= sheet->rows || 
+                source_col < 0 || source_col >= sheet->cols) {
+                set_error_at(sheet, target_row, target_col, 1);
+                return 1;
+            }
+            
+            if (error_at(sheet, source_row, source_col)) {
+                set_error_at(sheet, target_row, target_col, 1);
+                return 0;
+            }
+            
+            sleep_time = value_at(sheet, source_row, source_col);
+            sleep_row = source_row;
+            sleep_col = source_col;
+            
+            // Add dependency relationship
+            add_dependency(cell_at(sheet, target_row * sheet->cols + target_col), source_row * sheet->cols + source_col);
+            add_dependent(sheet, source_row, source_col, target_row * sheet->cols + target_col);
+        } else {
+            sleep_time = atoi(range_str);
+        }
+        
+        if (sleep_time <= 0) {
+            set_error_at(sheet, target_row, target_col, 1);
+            return 1;
+        }
+        
+        Formula formula = {FORMULA_SLEEP, 6, {0, 0, 0, sleep_time}, {0, 0, 0, 0}, 0, 0, 0, 0};
+        if (range_str[0] >= 'A' && range_str[0] <= 'Z') {
+            formula.left = (Operand){1, sleep_row, sleep_col, 0};
+        }
+        set_formula(sheet, target_row, target_col, &formula);
+        
+        sleep(sleep_time);
+        set_value_at(sheet, target_row, target_col, sleep_time);
+        
+        return 0;
+    }
+
+    char* colon = strchr(range_str, ':');
+    int start_row = 0, start_col = 0, end_row = 0, end_col = 0;
+
+    i = 0;
+    while(range_str[i] >= 'A' && range_str[i] <= 'Z') {
+        start_col = start_col * 26 + (range_str[i] - 'A' + 1);
+        i++;
+    }
+    start_col--; 
+    start_row = atoi(range_str + i) - 1;
+
+    if (colon) {
+        char* end_cell = colon + 1;
+        i = 0;
+        while(end_cell[i] >= 'A' && end_cell[i] <= 'Z') {
+            end_col = end_col * 26 + (end_cell[i] - 'A' + 1);
+            i++;
+        }
+        end_col--; 
+        end_row = atoi(end_cell + i) - 1; 
+    } else {
+
+        end_row = start_row;
+        end_col = start_col;
+    }
+
+    if (start_row < 0 || start_row >= sheet->rows || 
+        start_col < 0 || start_col >= sheet->cols ||
+        end_row < 0 || end_row >= sheet->rows ||
+        end_col < 0 || end_col >= sheet->cols ||
+        end_row < start_row || end_col < start_col) {
+        set_error_at(sheet, target_row, target_col, 1);
+        return 1; 
+    }
+
+    if (opcode < 1 || opcode > 5) {  // MIN, MAX, AVG, SUM or STDEV
+        set_error_at(sheet, target_row, target_col, 1);
+        return 1; 
+    }
+    
+    Formula formula = {FORMULA_FUNC, opcode, {0, 0, 0, 0}, {0, 0, 0, 0},
+                       start_row, start_col, end_row, end_col};
+    set_formula(sheet, target_row, target_col, &formula);
+
+    // Refuse the edit when its range edge could not be added
+    if (add_range_dependency(sheet, target_row, target_col, start_row, start_col, end_row, end_col) != 0) {
+        printf("Memory allocation failed\n");
+        clear_formula(sheet, target_row, target_col);
+        set_error_at(sheet, target_row, target_col, 1);
+        update_dependencies(sheet, target_row, target_col);
+        return 1;
+    }
+
+    // Same path as a recalculation, so later edits reuse its state
+    int status = evaluate_cell(sheet, target_row, target_col);
+    update_dependencies(sheet, target_row, target_col);
+    return status;
+}
+int setconst(char* cell_ref, char* value, struct Sheet* sheet) {
+    int target_row = 0, target_col = 0;
+    
+    int i = 0;
+    while(cell_ref[i] >= 'A' && cell_ref[i] <= 'Z') {
+        target_col = target_col * 26 + (cell_ref[i] - 'A' + 1);
+        i++;
+    }
+    target_col--;
+    target_row = atoi(cell_ref + i) - 1; 
+    
+    if(target_row < 0 || target_row >= sheet->rows || 
+       target_col < 0 || target_col >= sheet->cols) {
+        return 1; 
+    }
+    
+    begin_edit(sheet, target_row, target_col);
+    set_error_at(sheet, target_row, target_col, 0);
+    
+    clear_dependencies(sheet, target_row, target_col);
+    
+    int val;
+    
+    if(value[0] >= 'A' && value[0] <= 'Z') {
+        int source_row = 0, source_col = 0;
+        i = 0;
+        while(value[i] >= 'A' && value[i] <= 'Z') {
+            source_col = source_col * 26 + (value[i] - 'A' + 1);
+            i++;
+        }
+        source_col--;
+        source_row = atoi(value + i) - 1; 
+        
+        if(source_row < 0 || source_row >= sheet->rows || 
+           source_col < 0 || source_col >= sheet->cols) {
+            set_error_at(sheet, target_row, target_col, 1);
+            return 1; 
+        }
+        
+        if (error_at(sheet, source_row, source_col)) {
+            set_error_at(sheet, target_row, target_col, 1);
+        } else {
+            val = value_at(sheet, source_row, source_col);
+            set_value_at(sheet, target_row, target_col, val);
+        }
+        
+        add_dependency(cell_at(sheet, target_row * sheet->cols + target_col), source_row * sheet->cols + source_col);
+        add_dependent(sheet, source_row, source_col, target_row * sheet->cols + target_col);
+        
+        Formula formula = {FORMULA_REF, 0, {1, source_row, source_col, 0}, {0, 0, 0, 0}, 0, 0, 0, 0};
+        set_formula(sheet, target_row, target_col, &formula);
+    } else {
+        val = atoi(value);
+        set_value_at(sheet, target_row, target_col, val);
+        
+        clear_formula(sheet, target_row, target_col);
+    }
+    
+    update_dependencies(sheet, target_row, target_col);
+    return 0;
+}
+void get_column_name(int col, char* buffer) {
+    // 0-based indexing
+    col--;
+    
+    if (col < 26) {  
+        buffer[0] = 'A' + col;
+        buffer[1] = '\0';
+        return;
+    }
+    
+    // columns after Z
+    int first = col / 26;
+    int second = col % 26;
+    
+    if (first <= 26) {  
+        buffer[0] = 'A' + first - 1;
+        buffer[1] = 'A' + second;
+        buffer[2] = '\0';
+    } else {  
+        int third = second;
+        second = first % 26;
+        first = first / 26;
+        buffer[0] = 'A' + first - 1;
+        buffer[1] = 'A' + second - 1;
+        buffer[2] = 'A' + third;
+        buffer[3] = '\0';
+    }
+}
+
+int display(struct Sheet* sheet) {
+ 
+    if (sheet->suppress_output) {
+        return 0;
+    }
+    
+    char col_name[4];
+    
+
+    int end_row = sheet->view_row + 10;
+    int end_col = sheet->view_col + 10;
+    if (end_row > sheet->rows) end_row = sheet->rows;
+    if (end_col > sheet->cols) end_col = sheet->cols;
+    
+
+    printf("    ");
+    for(int j = sheet->view_col; j < end_col; j++) {
+        get_column_name(j + 1, col_name);
+        printf("%-4s ", col_name);
+    }
+    printf("\n");
+    
+
+    for(int i = sheet->view_row; i < end_row; i++) {
+        printf("%-3d ", i + 1);
+        for(int j = sheet->view_col; j < end_col; j++) {
+            if (error_at(sheet, i, j)) {
+                printf("ERR  ");
+            } else {
+                printf("%-4d ", value_at(sheet, i, j));
+            }
+        }
+        printf("\n");
+    }
+    return 0;
+}
+int scroll_to(struct Sheet* sheet, char* cell_ref) {
+    int target_row = 0, target_col = 0;
+    
+    int i = 0;
+    while (cell_ref[i] >= 'A' && cell_ref[i] <= 'Z') {
+        target_col = target_col * 26 + (cell_ref[i] - 'A' + 1);
+        i++;
+    }
+    target_col--; 
+    target_row = atoi(cell_ref + i) - 1;
+
+    if (target_row < 0 || target_row >= sheet->rows || 
+        target_col < 0 || target_col >= sheet->cols) {
+        return 1; 
+    }
+
+    sheet->view_row = target_row;
+    sheet->view_col = target_col;
+    
+    return 0;
+}
+
+int control(char* input, struct Sheet* sheet) {
+    switch (input[0]) {
+        case 'w':  
+            if (sheet->view_row >= 10) {
+                sheet->view_row -= 10;  
+            } else {
+                sheet->view_row = 0;  
+            }
+            break;
+
+        case 's': 
+            if (sheet->view_row + 20 <= sheet->rows) {
+                sheet->view_row += 10;  
+            } else if (sheet->rows > 10) {
+                sheet->view_row = sheet->rows - 10;  
+            }
+            break;
+
+        case 'a':  
+            if (sheet->view_col >= 10) {
+                sheet->view_col -= 10;  
+            } else {
+                sheet->view_col = 0;  
+            }
+            break;
+
+        case 'd':
+            if (sheet->view_col + 20 <= sheet->cols) {
+                sheet->view_col += 10; 
+            } else if (sheet->cols > 10) {
+                sheet->view_col = sheet->cols - 10;  
+            }
+            break;
+
+        default: 
+            return 1;
+    }
+    return 0; 
+}
+int handle_setarith(struct Sheet* sheet, char* target_cell_ref, char* left_operand, char* right_operand, char op) {
+    int target_row = 0, target_col = 0;
+
+    int i = 0;
+    while(target_cell_ref[i] >= 'A' && target_cell_ref[i] <= 'Z') {
+        target_col = target_col * 26 + (target_cell_ref[i] - 'A' + 1);
+        i++;
+    }
+    target_col--; 
+    target_row = atoi(target_cell_ref + i) - 1; 
+
+    if(target_row < 0 || target_row >= sheet->rows || 
+       target_col < 0 || target_col >= sheet->cols) {
+        return 1; 
+    }
+    
+    begin_edit(sheet, target_row, target_col);
+    set_error_at(sheet, target_row, target_col, 0);
+    
+    clear_dependencies(sheet, target_row, target_col);
+
+    int val1 = 0, val2 = 0;
+    int left_row = -1, left_col = 0;  
+    int right_row = -1, right_col = 0;  
+    int left_has_error = 0, right_has_error = 0;
+    
+    if(left_operand[0] >= 'A' && left_operand[0] <= 'Z') {
+        i = 0;
+        while(left_operand[i] >= 'A' && left_operand[i] <= 'Z') {
+            left_col = left_col * 26 + (left_operand[i] - 'A' + 1);
+            i++;
+        }
+        left_col--;
+        left_row = atoi(left_operand + i) - 1;
+        if(left_row < 0 || left_row >= sheet->rows || left_col < 0 || left_col >= sheet->cols) {
+            set_error_at(sheet, target_row, target_col, 1);
+            return 1;
+        }
+        
+        if (error_at(sheet, left_row, left_col)) {
+            left_has_error = 1;
+        } else {
+            val1 = value_at(sheet, left_row, left_col);
+        }
+        
+        add_dependency(cell_at(sheet, target_row * sheet->cols + target_col), left_row * sheet->cols + left_col);
+        add_dependent(sheet, left_row, left_col, target_row * sheet->cols + target_col);
+    } else {
+        val1 = atoi(left_operand);
+    }
+    
+    if(right_operand[0] >= 'A' && right_operand[0] <= 'Z') {
+        i = 0;
+        while(right_operand[i] >= 'A' && right_operand[i] <= 'Z') {
+            right_col = right_col * 26 + (right_operand[i] - 'A' + 1);
+            i++;
+        }
+        right_col--;
+        right_row = atoi(right_operand + i) - 1;
+        if(right_row < 0 || right_row >= sheet->rows || right_col < 0 || right_col >= sheet->cols) {
+            set_error_at(sheet, target_row, target_col, 1);
+            return 1; 
+        }
+        
+        if (error_at(sheet, right_row, right_col)) {
+            right_has_error = 1;
+        } else {
+            val2 = value_at(sheet, right_row, right_col);
+        }
+        
+        add_dependency(cell_at(sheet, target_row * sheet->cols + target_col), right_row * sheet->cols + right_col);
+        add_dependent(sheet, right_row, right_col, target_row * sheet->cols + target_col);
+    } else {
+        val2 = atoi(right_operand);
+    }
+    
+    int opcode = arith_opcode(op);
+    Formula formula = {FORMULA_ARITH, opcode, {0, 0, 0, 0}, {0, 0, 0, 0}, 0, 0, 0, 0};
+    formula.left = left_row < 0 ? (Operand){0, 0, 0, val1} : (Operand){1, left_row, left_col, 0};
+    formula.right = right_row < 0 ? (Operand){0, 0, 0, val2} : (Operand){1, right_row, right_col, 0};
+    set_formula(sheet, target_row, target_col, &formula);
+    
+    if (left_has_error || right_has_error) {
+        set_error_at(sheet, target_row, target_col, 1);
+        update_dependencies(sheet, target_row, target_col);
+        return 0;
+    }
+    
+    if (opcode == 0) {  // not one of + - * /
+        set_error_at(sheet, target_row, target_col, 1);
+        update_dependencies(sheet, target_row, target_col);
+        return 1; 
+    }
+    
+    if (opcode == 4 && val2 == 0) {
+        set_error_at(sheet, target_row, target_col, 1);
+        update_dependencies(sheet, target_row, target_col);
+        return 1;
+    }
+    
+    if (setarith(sheet, target_row * sheet->cols + target_col, val1, val2, opcode) != 0) {
+        update_dependencies(sheet, target_row, target_col);
+        return 1; 
+    }
+    
+    update_dependencies(sheet, target_row, target_col);
+    return 0;
+}
+struct Command* parse_input(char* input) {
+    if (input != NULL) {
+        input[strcspn(input, "\r\n")] = '\0';
+    }
+    if (input == NULL || input[0] == '\0') {
+        struct Command* cmd = malloc(sizeof(struct Command));
+        if(cmd != NULL) {
+            for (int i = 0; i < 4; i++)
+                cmd->args[i] = NULL;
+            cmd->type = CMD_INVALID;
+        }
+        return cmd;
+    }
+    struct Command* cmd = malloc(sizeof(struct Command));
+    if (cmd == NULL) return NULL;
+    
+    for(int i = 0; i < 4; i++) {
+        cmd->args[i] = NULL;
+    }
+    if (strcmp(input, "disable_output") == 0) {
+        cmd->type = CMD_DISABLE_OUTPUT;
+        return cmd;
+    }
+    
+    if (strcmp(input, "enable_output") == 0) {
+        cmd->type = CMD_ENABLE_OUTPUT;
+        return cmd;
+    }
+    if (strcmp(input, "freeze") == 0) {
+        cmd->type = CMD_FREEZE;
+        return cmd;
+    }
+    if (strcmp(input, "thaw") == 0) {
+        cmd->type = CMD_THAW;
+        return cmd;
+    }
+    if (strcmp(input, "enable_jit") == 0) {
+        cmd->type = CMD_ENABLE_JIT;
+        return cmd;
+    }
+    if (strcmp(input, "disable_jit") == 0) {
+        cmd->type = CMD_DISABLE_JIT;
+        return cmd;
+    }
+    if (strncmp(input, "scroll_to ", 10) == 0) {
+        cmd->type = CMD_SCROLL_TO;
+        cmd->args[0] = strdup(input + 10); 
+        return cmd;
+    }
+    if (strlen(input) == 1) {
+        switch(input[0]) {
+            case 'w':
+            case 'a':
+            case 's':
+            case 'd':
+            case 'q':
+                cmd->type = CMD_CONTROL;
+                cmd->args[0] = malloc(strlen(input) + 1);
+                if (cmd->args[0] != NULL) {
+                    strcpy(cmd->args[0], input);
+                }
+                return cmd;
+        }
+    }
+    char* equals = strchr(input, '=');
+    if (equals != NULL) {
+        *equals = '\0';  
+        char* cell = input;
+        char* value = equals + 1;
+        while(*cell && isspace(*cell)) cell++;
+        while(*value && isspace(*value)) value++;
+        char* end = cell + strlen(cell) - 1;
+        while(end > cell && isspace(*end)) *end-- = '\0';
+        end = value + strlen(value) - 1;
+        while(end > value && isspace(*end)) *end-- = '\0';
+        char* open_paren = strchr(value, '(');
+        char* close_paren = strchr(value, ')');
+        if (open_paren && close_paren && open_paren < close_paren) {
+            int func_len = open_paren - value;
+            char func_name[10] = {0};  
+            strncpy(func_name, value, func_len);
+            char* arg = open_paren + 1;
+            *close_paren = '\0';
+            
+            cmd->type = CMD_SETFUNC;
+            cmd->args[0] = strdup(cell);     
+            
+            if (strcmp(func_name, "SLEEP") == 0) {
+                cmd->args[1] = strdup(arg);
+                cmd->args[2] = strdup("6");
+                return cmd;
+            }
+
+            cmd->args[1] = strdup(arg);
+
+
+            if (strcmp(func_name, "MIN") == 0) cmd->args[2] = strdup("1");
+            else if (strcmp(func_name, "MAX") == 0) cmd->args[2] = strdup("2");
+            else if (strcmp(func_name, "AVG") == 0) cmd->args[2] = strdup("3");
+            else if (strcmp(func_name, "SUM") == 0) cmd->args[2] = strdup("4");
+            else if (strcmp(func_name, "STDEV") == 0) cmd->args[2] = strdup("5");
+            else {
+                cmd->type = CMD_INVALID;
+                return cmd;
+            }
+            return cmd;
+        }
+        char* operator = strpbrk(value, "+-*/");
+        if (operator != NULL) {
+
+            char opcode = *operator;
+            *operator = '\0';  
+            
+            cmd->type = CMD_SETARITH;
+            cmd->args[0] = malloc(strlen(cell) + 1);
+            cmd->args[1] = malloc(strlen(value) + 1);
+            cmd->args[2] = malloc(strlen(operator+1)+1);
+            cmd->args[3] = malloc(2); 
+            
+            if(cmd->args[0] && cmd->args[1] && cmd->args[2] && cmd->args[3]) {
+                strcpy(cmd->args[0], cell);    
+                strcpy(cmd->args[1], value);   
+                strcpy(cmd->args[2], operator + 1); 
+                
+
+                cmd->args[3][0]= opcode;
+                cmd->args[3][1] = '\0';
+                return cmd;
+            } else {
+                printf("Memory allocation failed\n");
+                free(cmd->args[0]);
+                free(cmd->args[1]);
+                free(cmd->args[2]);
+                free(cmd->args[3]);
+                cmd->args[0] = cmd->args[1] = cmd->args[2]= cmd->args[3] = NULL;
+                cmd->type = CMD_INVALID;
+                *operator = opcode;
+                
+                return cmd;
+            }
+        } else if (strlen(value) > 0) {
+            cmd->type = CMD_SETCONST;
+            cmd->args[0] = malloc(strlen(cell) + 1);
+            cmd->args[1] = malloc(strlen(value) + 1);
+            if (cmd->args[0] && cmd->args[1]) {
+                strcpy(cmd->args[0], cell);
+                strcpy(cmd->args[1], value);
+                return cmd;
+            }
+        }
+    }
+ 
+    cmd->type = CMD_INVALID;
+    return cmd;
+}
+int main(int argc, char *argv[]) {
+    struct Sheet* sheet = NULL;
+    int state = 0;  // Will store this in sheet later
+    char input[1024];
+ 
+    if (state == 0) {
+        if (argc != 3) {
+            printf("Usage: ./sheet <rows> <cols>\n"); 
+            return 1;
+        }
+ 
+        sheet = malloc(sizeof(struct Sheet));
+        if (sheet == NULL) {
+            printf("Memory allocation failed\n");
+            return 1;
+        }
+ 
+        sheet->rows = atoi(argv[1]);
+        sheet->cols = atoi(argv[2]);
+        sheet->view_row = 0;
+        sheet->view_col = 0;
+        sheet->suppress_output = 0; 
+        sheet->range_index = NULL;
+        sheet->range_hits.items = NULL;
+        sheet->range_hits.count = 0;
+        sheet->range_hits.capacity = 0;
+        sheet->worklist = (Worklist){NULL, 0, 0};
+        sheet->cyclic_cells = (CellSet){NULL, 0, 0, 0};
+        sheet->rank_forward = (Worklist){NULL, 0, 0};
+        sheet->rank_backward = (Worklist){NULL, 0, 0};
+        sheet->rank_touched = (Worklist){NULL, 0, 0};
+        sheet->ranked_hits = (Worklist){NULL, 0, 0};
+        sheet->rank_low = 1 << 30;
+        sheet->rank_high = 1 << 30;
+        sheet->epoch = 0;
+        sheet->dirty = (Worklist){NULL, 0, 0};
+        sheet->order = (Worklist){NULL, 0, 0};
+        sheet->frozen = (DependentsCSR){NULL, NULL, NULL, 0, 0, {NULL, 0, 0, 0}};
+        sheet->jit = (JitArena){0, NULL, NULL, 0, 0, NULL, 0, 0, {NULL, 0, 0}};
+        sheet->formulas = (FormulaTable){NULL, NULL, 0, 0, {NULL, 0, 0}, NULL, 0, 0};
+        sheet->changed = (Worklist){NULL, 0, 0};
+        sheet->old_values = (Worklist){NULL, 0, 0};
+        sheet->edit_pending = 0;
+        sheet->column_ranges = calloc(sheet->cols, sizeof(int));
+        sheet->columns = calloc(sheet->cols, sizeof(ColumnIndex*));
+        sheet->aggregates = (AggregateTable){NULL, 0, 0};
+        sheet->aggregate_stamp = 0;
+        range_kernels_select(&sheet->kernels);
+        if (sheet->column_ranges == NULL || sheet->columns == NULL) {
+            free(sheet->column_ranges);
+            free(sheet->columns);
+            free(sheet);
+            printf("Memory allocation failed\n");
+            return 1;
+        }
+        // Every cell starts as an empty constant with no tile or record
+        sheet->tile_rows = (sheet->rows + TILE_MASK) >> TILE_SHIFT;
+        sheet->tile_cols = (sheet->cols + TILE_MASK) >> TILE_SHIFT;
+        int log_cols = 0;
+        while ((1LL << log_cols) < sheet->cols) log_cols++;
+        sheet->col_shift = 32 + log_cols;
+        sheet->col_magic = sheet->cols > 0 ? ((1ULL << sheet->col_shift) + sheet->cols - 1) / sheet->cols : 0;
+        sheet->tiles = calloc((size_t)sheet->tile_rows * sheet->tile_cols, sizeof(Tile*));
+        memset(&sheet->empty, 0, sizeof(Tile));
+        sheet->record_pages = (int)(((size_t)sheet->rows * sheet->cols + RECORD_PAGE_SIZE - 1) >> RECORD_PAGE_SHIFT);
+        sheet->records = calloc(sheet->record_pages, sizeof(struct Cell**));
+        if (sheet->tiles == NULL || sheet->records == NULL) {
+            free(sheet->tiles);
+            free(sheet->records);
+            free(sheet->column_ranges);
+            free(sheet->columns);
+            free(sheet);
+            printf("Memory allocation failed\n");
+            return 1;
+        }
+        cell_init(&sheet->blank);
+        
+        state = 1;
+        display(sheet);  
+    }
+
+    while(state == 1) {
+        printf("> ");
+        
+        if (fgets(input, sizeof(input), stdin) == NULL) {
+            break;
+        }
+        input[strcspn(input, "\n")] = 0;
+ 
+        struct Command* cmd = parse_input(input);
+        if (cmd == NULL) {
+            printf("Memory allocation failed\n");
+            continue;
+        }
+        switch(cmd->type) {
+            case CMD_CONTROL:
+                if (cmd->args[0][0] == 'q') {
+                    state = 0;  
+                }
+                else {
+                    control(cmd->args[0], sheet);
+                    if (!sheet->suppress_output) {
+                        display(sheet);
+                    }
+                }
+                break;
+ 
+            case CMD_SETCONST:
+                if (setconst(cmd->args[0], cmd->args[1], sheet) != 0) {
+                    printf("Invalid cell reference or value\n");
+                }
+                if (!sheet->suppress_output) {
+                    display(sheet);
+                }
+                break;
+                
+            case CMD_SETARITH:
+                if (handle_setarith(sheet, cmd->args[0], cmd->args[1], cmd->args[2], cmd->args[3][0]) != 0) {
+                    printf("Arithmetic error (division-by-zero, or invalid reference)\n");
+                }
+                if (!sheet->suppress_output) {
+                    display(sheet);
+                }
+                break;
+               
+            case CMD_SETFUNC:
+                if (handle_setfunc(sheet, cmd->args[0], cmd->args[1], atoi(cmd->args[2])) != 0) {
+                    printf("Error applying function to range\n");
+                }
+                if (!sheet->suppress_output) {
+                    display(sheet);
+                }
+                break;
+                
+            case CMD_DISABLE_OUTPUT:
+                sheet->suppress_output = 1;
+                break;
+                
+            case CMD_ENABLE_OUTPUT:
+                if (sheet->suppress_output) {
+                    sheet->suppress_output = 0;
+                    
+                }
+                break;
+                
+            case CMD_FREEZE:
+                if (csr_compact(sheet) != 0) {
+                    printf("Memory allocation failed\n");
+                }
+                break;
+                
+            case CMD_THAW:
+                csr_free(&sheet->frozen);
+                break;
+                
+            case CMD_ENABLE_JIT:
+                jit_set_enabled(sheet, 1);
+                break;
+                
+            case CMD_DISABLE_JIT:
+                jit_set_enabled(sheet, 0);
+                break;
+                
+            case CMD_SCROLL_TO:
+                if (scroll_to(sheet, cmd->args[0]) != 0) {
+                    printf("Invalid cell reference for scroll_to\n");
+                }
+                if (!sheet->suppress_output) {
+                    display(sheet);
+                }
+                break;
+                
+            case CMD_INVALID:
+                printf("Invalid command\n");
+                break;
+        }
+        for(int i = 0; i < 4; i++) {
+            free(cmd->args[i]);
+        }
+        free(cmd);
+    }
+    if (sheet) {
+        if (sheet->records) {
+            for (int p = 0; p < sheet->record_pages; p++) {
+                for (int k = 0; sheet->records[p] && k < RECORD_PAGE_SIZE; k++) {
+                    struct Cell* cell = sheet->records[p][k];
+                    if (cell) {
+                        cellset_free(&cell->depends_on);
+                        cellset_free(&cell->dependents);
+                        free(cell);
+                    }
+                }
+                free(sheet->records[p]);
+            }
+            free(sheet->records);
+        }
+        if (sheet->tiles) {
+            for (int t = 0; t < sheet->tile_rows * sheet->tile_cols; t++) {
+                free(sheet->tiles[t]);
+            }
+            free(sheet->tiles);
+        }
+        if (sheet->range_index) {
+            RangeList ranges = {NULL, 0, 0};
+            rtree_release(sheet->range_index, &ranges);
+            for (int i = 0; i < ranges.count; i++) {
+                free(ranges.items[i]);
+            }
+            free(ranges.items);
+        }
+        free(sheet->range_hits.items);
+        free(sheet->worklist.items);
+        cellset_free(&sheet->cyclic_cells);
+        free(sheet->rank_forward.items);
+        free(sheet->rank_backward.items);
+        free(sheet->rank_touched.items);
+        free(sheet->ranked_hits.items);
+        free(sheet->dirty.items);
+        free(sheet->order.items);
+        csr_free(&sheet->frozen);
+        jit_free(&sheet->jit);
+        free(sheet->jit.pending.items);
+        formula_table_free(&sheet->formulas);
+        free(sheet->changed.items);
+        free(sheet->old_values.items);
+        for (int c = 0; c < sheet->cols; c++) {
+            column_index_free(sheet, c);
+        }
+        free(sheet->columns);
+        free(sheet->column_ranges);
+        aggregate_table_free(&sheet->aggregates);
+        free(sheet);
+    }
+    
+    return 0;
+ }